@@ -4,6 +4,7 @@ CONFIG -= app_bundle
 CONFIG -= qt
 CONFIG += c++11
 QMAKE_CXXFLAGS += -fopenmp
+QMAKE_LFLAGS *= -fopenmp
 
 
 macx{
@@ -12,7 +13,6 @@ INCLUDEPATH += /usr/local/include
 }
 
 win32{
-QMAKE_LFLAGS *= -fopenmp
 LIBS += C:\Libraries\SDL2_image-2.0.0\i686-w64-mingw32\lib\libSDL2_image.a \
     C:\Libraries\SDL2-2.0.3\lib\x86\SDL2main.lib \
     C:\Libraries\SDL2-2.0.3\lib\x86\SDL2.lib
@@ -21,17 +21,32 @@ INCLUDEPATH += C:\Libraries\SDL2-2.0.3\include \
 }
 
 SOURCES += main.cpp \
+    babylonloader.cpp \
+    blockcompression.cpp \
     camera.cpp \
     mesh.cpp \
+    meshoptimizer.cpp \
     device.cpp \
     color.cpp \
     json/json.cpp \
-    texture.cpp
+    mappedfile.cpp \
+    scenefile.cpp \
+    texture.cpp \
+    texturecache.cpp \
+    threadpool.cpp
 
 HEADERS += \
+    babylonloader.h \
+    blockcompression.h \
     camera.h \
     mesh.h \
+    meshoptimizer.h \
     device.h \
     color.h \
     json/json.h \
-    texture.h
+    mappedfile.h \
+    scenefile.h \
+    simd.h \
+    texture.h \
+    texturecache.h \
+    threadpool.h
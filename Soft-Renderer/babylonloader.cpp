@@ -0,0 +1,622 @@
+#include "babylonloader.h"
+#include "mappedfile.h"
+#include <cstdlib>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+namespace SoftEngine
+{
+// Pull parser over a JSON text. Errors stop it at the end of the text,
+// so every loop ends and failed() tells what happened.
+class JsonReader
+{
+private:
+    const char *m_begin;
+    const char *m_position;
+    const char *m_end;
+    bool m_failed = false;
+
+    void skipWhitespace()
+    {
+        while(m_position < m_end && (*m_position == ' ' || *m_position == '\n' || *m_position == '\r' || *m_position == '\t'))
+            ++m_position;
+    }
+
+    static bool isNumberCharacter(char c)
+    {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    double parseNumberSlow(const char *begin, const char *end);
+    void skipString();
+public:
+    JsonReader(const char *begin, const char *end)
+        : m_begin(begin), m_position(begin), m_end(end)
+    {}
+    // Reads only [begin, end) of the text of reader, offsets stay relative to its start
+    JsonReader(const JsonReader& reader, const char *begin, const char *end)
+        : m_begin(reader.m_begin), m_position(begin), m_end(end)
+    {}
+
+    bool failed() const { return m_failed; }
+    const char* position() const { return m_position; }
+    size_t offset() const { return m_position - m_begin; }
+
+    void fail()
+    {
+        if(!m_failed)
+            std::cerr << "Unexpected character at offset " << this->offset() << std::endl;
+        this->stop();
+    }
+
+    // Fails without a message, when it was already given
+    void stop()
+    {
+        m_failed = true;
+        m_position = m_end;
+    }
+
+    char peek()
+    {
+        this->skipWhitespace();
+        return m_position < m_end ? *m_position : '\0';
+    }
+
+    bool consume(char c)
+    {
+        if(this->peek() != c)
+            return false;
+        ++m_position;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if(!this->consume(c))
+            this->fail();
+    }
+
+    // Moves to the next key of the object whose '{' was consumed, false at its end
+    bool nextMember(bool& first, std::string& key)
+    {
+        if(this->consume('}'))
+            return false;
+        if(!first)
+            this->expect(',');
+        first = false;
+        this->readString(key);
+        this->expect(':');
+        return !m_failed;
+    }
+
+    // Moves to the next element of the array whose '[' was consumed, false at its end
+    bool nextElement(bool& first)
+    {
+        if(this->consume(']'))
+            return false;
+        if(!first)
+            this->expect(',');
+        first = false;
+        return !m_failed;
+    }
+
+    // Elements of the array whose '[' was just consumed, -1 unless they are all numbers
+    int countNumbers() const;
+
+    void readString(std::string& value);
+    double readNumber();
+    float readFloat() { return static_cast<float>(this->readNumber()); }
+    int readInt() { return static_cast<int>(this->readNumber()); }
+    void skipValue();
+    // Moves past the object or array starting here, only matching the brackets
+    // outside strings. Its content is not checked, it has to be read afterwards.
+    void delimitValue();
+};
+
+int JsonReader::countNumbers() const
+{
+    int separators = 0;
+    bool empty = true;
+    for(const char *c = m_position; c < m_end; ++c) {
+        if(*c == ']')
+            return empty ? 0 : separators + 1;
+        if(*c == ',')
+            ++separators;
+        else if(isNumberCharacter(*c))
+            empty = false;
+        else if(*c != ' ' && *c != '\n' && *c != '\r' && *c != '\t')
+            return -1;
+    }
+    return -1;
+}
+
+void JsonReader::readString(std::string& value)
+{
+    value.clear();
+    this->expect('"');
+    while(m_position < m_end && *m_position != '"') {
+        char c = *m_position++;
+        if(c != '\\') {
+            value += c;
+            continue;
+        }
+        if(m_position >= m_end)
+            break;
+        switch(*m_position++) {
+        case 'b': value += '\b'; break;
+        case 'f': value += '\f'; break;
+        case 'n': value += '\n'; break;
+        case 'r': value += '\r'; break;
+        case 't': value += '\t'; break;
+        case 'u': {
+            if(m_end - m_position < 4) {
+                this->fail();
+                return;
+            }
+            unsigned int code = std::strtoul(std::string(m_position, 4).c_str(), nullptr, 16);
+            m_position += 4;
+            // UTF-8, surrogate pairs are kept as two code points
+            if(code < 0x80) {
+                value += static_cast<char>(code);
+            } else if(code < 0x800) {
+                value += static_cast<char>(0xc0 | (code >> 6));
+                value += static_cast<char>(0x80 | (code & 0x3f));
+            } else {
+                value += static_cast<char>(0xe0 | (code >> 12));
+                value += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                value += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            break;
+        }
+        default: value += m_position[-1]; break;
+        }
+    }
+    this->expect('"');
+}
+
+void JsonReader::skipString()
+{
+    ++m_position;
+    while(m_position < m_end && *m_position != '"') {
+        if(*m_position == '\\')
+            ++m_position;
+        ++m_position;
+    }
+    if(m_position >= m_end)
+        this->fail();
+    else
+        ++m_position;
+}
+
+// Exact powers of ten of a double
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// When the digits fit in the 53 bits of a double and the power of ten is exact,
+// one multiplication or division gives the correctly rounded value, like strtod does.
+double JsonReader::readNumber()
+{
+    this->skipWhitespace();
+    const char *begin = m_position;
+    const char *c = m_position;
+
+    bool negative = c < m_end && *c == '-';
+    if(negative)
+        ++c;
+
+    Uint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char *digitsBegin = c;
+    for(; c < m_end && *c >= '0' && *c <= '9'; ++c, ++digits)
+        mantissa = mantissa * 10 + (*c - '0');
+    bool valid = c != digitsBegin;
+    if(c < m_end && *c == '.') {
+        const char *fractionBegin = ++c;
+        for(; c < m_end && *c >= '0' && *c <= '9'; ++c, ++digits)
+            mantissa = mantissa * 10 + (*c - '0');
+        exponent -= c - fractionBegin;
+        valid = valid && c != fractionBegin;
+    }
+    if(c < m_end && (*c == 'e' || *c == 'E')) {
+        ++c;
+        bool negativeExponent = c < m_end && *c == '-';
+        if(c < m_end && (*c == '-' || *c == '+'))
+            ++c;
+        int value = 0;
+        const char *exponentBegin = c;
+        for(; c < m_end && *c >= '0' && *c <= '9'; ++c)
+            value = value < 10000 ? value * 10 + (*c - '0') : value;
+        exponent += negativeExponent ? -value : value;
+        valid = valid && c != exponentBegin;
+    }
+
+    if(!valid) {
+        this->fail();
+        return 0.0;
+    }
+    m_position = c;
+
+    if(digits > 15 || exponent < -22 || exponent > 22)
+        return this->parseNumberSlow(begin, c);
+
+    double value = static_cast<double>(mantissa);
+    value = exponent < 0 ? value / POWERS_OF_TEN[-exponent] : value * POWERS_OF_TEN[exponent];
+    return negative ? -value : value;
+}
+
+double JsonReader::parseNumberSlow(const char *begin, const char *end)
+{
+    return std::strtod(std::string(begin, end).c_str(), nullptr);
+}
+
+void JsonReader::skipValue()
+{
+    int depth = 0;
+    do {
+        char c = this->peek();
+        if(c == '"') {
+            this->skipString();
+        } else if(c == '{' || c == '[') {
+            ++depth;
+            ++m_position;
+        } else if(c == '}' || c == ']') {
+            if(--depth < 0) {
+                this->fail();
+                return;
+            }
+            ++m_position;
+        } else if(c == ',' || c == ':') {
+            if(depth == 0) {
+                this->fail();
+                return;
+            }
+            ++m_position;
+        } else if(isNumberCharacter(c) || (c >= 'a' && c <= 'z')) {
+            while(m_position < m_end && (isNumberCharacter(*m_position) || (*m_position >= 'a' && *m_position <= 'z')))
+                ++m_position;
+        } else {
+            this->fail();
+            return;
+        }
+    } while(depth > 0 && !m_failed);
+}
+
+void JsonReader::delimitValue()
+{
+    char c = this->peek();
+    if(c != '{' && c != '[') {
+        this->fail();
+        return;
+    }
+
+    // Numbers make up most of the scenes, only the quotes and brackets are looked at
+    static const struct Delimiters
+    {
+        bool table[256] = {};
+        Delimiters() { table['"'] = table['{'] = table['['] = table['}'] = table[']'] = true; }
+    } delimiters;
+
+    int depth = 0;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(m_position);
+    const unsigned char *end = reinterpret_cast<const unsigned char *>(m_end);
+    for(; p < end; ++p) {
+        if(!delimiters.table[*p])
+            continue;
+        if(*p == '"') {
+            for(++p; p < end && *p != '"'; ++p) {
+                if(*p == '\\')
+                    ++p;
+            }
+        } else if(*p == '{' || *p == '[') {
+            ++depth;
+        } else if(--depth == 0) {
+            m_position = reinterpret_cast<const char *>(p + 1);
+            return;
+        }
+    }
+    // Unterminated, the error is at the end of the text
+    m_position = m_end;
+    this->fail();
+}
+
+// Babylon vertices are the position, the normal, then one pair of texture coordinates per uv set
+static int vertexStep(int uvCount)
+{
+    switch(uvCount) {
+    case 0: return 6;
+    case 1: return 8;
+    case 2: return 10;
+    default: return 0;
+    }
+}
+
+static void setVertex(Vertex& vertex, const float *values, int uvCount)
+{
+    vertex.coordinates = glm::vec3(values[0], values[1], values[2]);
+    vertex.normal = glm::vec3(values[3], values[4], values[5]);
+    if(uvCount > 0)
+        vertex.textureCoordinates = glm::vec2(values[6], values[7]);
+}
+
+// Reads the vertices array into the mesh, its '[' consumed. The array is
+// counted first so the vertices are allocated once and written in place.
+static void readVertices(JsonReader& reader, int uvCount, std::vector<Vertex>& vertices)
+{
+    int step = vertexStep(uvCount);
+    int count = reader.countNumbers();
+    if(count < 0) {
+        reader.fail();
+        return;
+    }
+
+    vertices.resize(count / step);
+    bool first = true;
+    float values[10];
+    for(Vertex& vertex : vertices) {
+        for(int i = 0; i < step; ++i) {
+            if(!reader.nextElement(first))
+                return;
+            values[i] = reader.readFloat();
+        }
+        setVertex(vertex, values, uvCount);
+    }
+    // What is left of an incomplete vertex
+    while(reader.nextElement(first))
+        reader.readFloat();
+}
+
+static void readFaces(JsonReader& reader, std::vector<Face>& faces)
+{
+    int count = reader.countNumbers();
+    if(count < 0) {
+        reader.fail();
+        return;
+    }
+
+    faces.resize(count / 3);
+    bool first = true;
+    for(Face& face : faces) {
+        int indices[3];
+        for(int i = 0; i < 3; ++i) {
+            if(!reader.nextElement(first))
+                return;
+            indices[i] = reader.readInt();
+        }
+        face.A = indices[0];
+        face.B = indices[1];
+        face.C = indices[2];
+    }
+    while(reader.nextElement(first))
+        reader.readInt();
+}
+
+// Diffuse texture of every material, by id
+typedef std::unordered_map<std::string, std::string> MaterialTextures;
+
+static void readMaterials(JsonReader& reader, MaterialTextures& materials)
+{
+    std::string key;
+    std::string id;
+    std::string texture;
+
+    reader.expect('[');
+    bool firstMaterial = true;
+    while(reader.nextElement(firstMaterial)) {
+        id.clear();
+        texture.clear();
+        reader.expect('{');
+        bool first = true;
+        while(reader.nextMember(first, key)) {
+            if(key == "id") {
+                reader.readString(id);
+            } else if(key == "diffuseTexture" && reader.peek() == '{') {
+                reader.expect('{');
+                bool firstTextureMember = true;
+                while(reader.nextMember(firstTextureMember, key)) {
+                    if(key == "name")
+                        reader.readString(texture);
+                    else
+                        reader.skipValue();
+                }
+            } else {
+                reader.skipValue();
+            }
+        }
+        materials[id] = texture;
+    }
+}
+
+// Without a cache only the name is recorded
+static void setTexture(Mesh& mesh, const std::string& textureName, TextureCache *textures)
+{
+    if(textures) {
+        // Meshes are read in parallel and the cache is not thread safe
+        #pragma omp critical(textureCache)
+        mesh.setTexture(textures->load(textureName));
+    }
+    mesh.setTextureName(textureName);
+}
+
+// Reads one mesh object. Returns true when the mesh needs the texture of
+// materialId but the materials were not read yet.
+static bool readMesh(JsonReader& reader, Mesh& mesh, const MaterialTextures *materials,
+                     std::string& materialId, TextureCache *textures)
+{
+    std::string key;
+    int uvCount = -1;
+    bool hasMaterial = false;
+    bool textureQueued = false;
+    // Vertex values seen before the uv count, laid out once it is known
+    std::vector<float> values;
+
+    reader.expect('{');
+    bool first = true;
+    while(reader.nextMember(first, key)) {
+        if(key == "name") {
+            std::string name;
+            reader.readString(name);
+            mesh.setName(name);
+        } else if(key == "materialId" && reader.peek() == '"') {
+            reader.readString(materialId);
+            hasMaterial = true;
+        } else if(key == "uvCount") {
+            uvCount = reader.readInt();
+            if(vertexStep(uvCount) == 0) {
+                std::cerr << "Unsupported uv count " << uvCount << std::endl;
+                reader.fail();
+            }
+        } else if(key == "position") {
+            float position[3] = {};
+            reader.expect('[');
+            bool firstCoordinate = true;
+            for(int i = 0; reader.nextElement(firstCoordinate); ++i) {
+                float value = reader.readFloat();
+                if(i < 3)
+                    position[i] = value;
+            }
+            mesh.setPosition(glm::vec3(position[0], position[1], position[2]));
+        } else if(key == "vertices") {
+            reader.expect('[');
+            if(uvCount >= 0) {
+                readVertices(reader, uvCount, mesh.vertices());
+            } else {
+                bool firstValue = true;
+                while(reader.nextElement(firstValue))
+                    values.push_back(reader.readFloat());
+            }
+        } else if(key == "indices") {
+            reader.expect('[');
+            readFaces(reader, mesh.faces());
+        } else {
+            reader.skipValue();
+        }
+
+        // Queued as early as possible, so the image is decoded while the geometry is read
+        if(!textureQueued && uvCount > 0 && hasMaterial && materials) {
+            auto material = materials->find(materialId);
+            setTexture(mesh, material != materials->end() ? material->second : std::string(), textures);
+            textureQueued = true;
+        }
+    }
+    if(reader.failed())
+        return false;
+
+    if(!values.empty()) {
+        int step = vertexStep(uvCount < 0 ? 0 : uvCount);
+        mesh.vertices().resize(values.size() / step);
+        for(size_t i = 0; i < mesh.vertices().size(); ++i)
+            setVertex(mesh.vertices()[i], &values[i * step], uvCount);
+    }
+
+    mesh.computeFaceNormal();
+    mesh.computeBounds();
+    if(uvCount <= 0 && textures) {
+        // Nothing to map a texture with
+        #pragma omp critical(textureCache)
+        mesh.setTexture(textures->white());
+    }
+    return !textureQueued && uvCount > 0;
+}
+
+// Mesh waiting for the materials, when they come after the meshes in the file
+struct PendingTexture
+{
+    int mesh;
+    std::string materialId;
+};
+
+// The mesh objects are first only delimited, then read in parallel, each one
+// into its own slot of meshes so the order does not depend on the threads
+static void readMeshes(JsonReader& reader, std::vector<Mesh>& meshes, const MaterialTextures *materials,
+                       std::vector<PendingTexture>& pending, TextureCache *textures)
+{
+    std::vector<std::pair<const char *, const char *>> spans;
+    reader.expect('[');
+    bool first = true;
+    while(reader.nextElement(first)) {
+        const char *begin = reader.position();
+        reader.delimitValue();
+        spans.push_back(std::make_pair(begin, reader.position()));
+    }
+    if(reader.failed())
+        return;
+
+    int count = spans.size();
+    size_t firstMesh = meshes.size();
+    meshes.insert(meshes.end(), count, Mesh("", 0, 0));
+    std::vector<std::string> materialIds(count);
+    std::vector<Uint8> needsTexture(count, 0);
+    std::vector<Uint8> failed(count, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int i = 0; i < count; ++i) {
+        JsonReader meshReader(reader, spans[i].first, spans[i].second);
+        needsTexture[i] = readMesh(meshReader, meshes[firstMesh + i], materials, materialIds[i], textures);
+        failed[i] = meshReader.failed();
+    }
+
+    for(int i = 0; i < count; ++i) {
+        // Like a sequential read, only the meshes before the first error are kept
+        if(failed[i]) {
+            meshes.erase(meshes.begin() + firstMesh + i, meshes.end());
+            reader.stop();
+            return;
+        }
+        if(needsTexture[i])
+            pending.push_back(PendingTexture{static_cast<int>(firstMesh + i), materialIds[i]});
+    }
+}
+
+static bool readBabylonFile(const std::string& filename, std::vector<Mesh>& meshes, TextureCache *textures)
+{
+    MappedFile file;
+    if(!file.open(filename)) {
+        std::cerr << "Cannot open scene named " << filename << std::endl;
+        return false;
+    }
+
+    const char *text = reinterpret_cast<const char *>(file.data());
+    JsonReader reader(text, text + file.size());
+    MaterialTextures materials;
+    bool materialsRead = false;
+    std::vector<PendingTexture> pending;
+
+    std::string key;
+    reader.expect('{');
+    bool first = true;
+    while(reader.nextMember(first, key)) {
+        if(key == "materials") {
+            readMaterials(reader, materials);
+            materialsRead = true;
+        } else if(key == "meshes") {
+            readMeshes(reader, meshes, materialsRead ? &materials : nullptr, pending, textures);
+        } else {
+            reader.skipValue();
+        }
+    }
+
+    for(const PendingTexture& texture : pending)
+        setTexture(meshes[texture.mesh], materials[texture.materialId], textures);
+
+    if(reader.failed()) {
+        std::cerr << "Cannot parse scene named " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool loadBabylonFile(const std::string& filename, std::vector<Mesh>& meshes, TextureCache& textures)
+{
+    return readBabylonFile(filename, meshes, &textures);
+}
+
+bool loadBabylonFile(const std::string& filename, std::vector<Mesh>& meshes)
+{
+    return readBabylonFile(filename, meshes, nullptr);
+}
+
+}//end of namespace
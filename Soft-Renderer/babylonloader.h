@@ -0,0 +1,22 @@
+#ifndef BABYLONLOADER_H
+#define BABYLONLOADER_H
+
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "texturecache.h"
+
+namespace SoftEngine
+{
+// Reads the meshes of a Babylon JSON scene in one pass over the mapped file.
+// Numbers go straight into the vertices and faces of the meshes, no document
+// is built. Textures are queued on the cache as soon as a mesh names its material.
+// Returns false when the file cannot be read or is not valid JSON, the meshes
+// read until then are kept.
+bool loadBabylonFile(const std::string& filename, std::vector<Mesh>& meshes, TextureCache& textures);
+// Only records the texture names of the meshes, no image is loaded and the
+// meshes are left without a texture. For tools which do not render.
+bool loadBabylonFile(const std::string& filename, std::vector<Mesh>& meshes);
+}// end of namespace
+
+#endif // BABYLONLOADER_H
@@ -0,0 +1,153 @@
+// Compares the linear and tiled texture layouts when a texture is drawn
+// rotated onto the screen, the way the spinning monkey samples its texture.
+// Pixels are visited in 8x8 blocks like the half-space rasterizer does, and
+// every angle reports the sampling throughput and the hit rate of a
+// simulated 32 KB, 8-way L1 data cache on the texel addresses.
+
+#include "texture.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace SoftEngine;
+
+static const int TEXTURE_SIZE = 1024;
+static const int SCREEN_SIZE = 512;
+static const int RASTER_BLOCK_SIZE = 8;
+static const int REPETITIONS = 20;
+
+// Least recently used replacement, 64 byte lines
+class CacheSimulator
+{
+private:
+    static const int LINE_SIZE = 64;
+    static const int WAYS = 8;
+    static const int SETS = 32 * 1024 / LINE_SIZE / WAYS;
+    size_t m_tags[SETS][WAYS];
+    unsigned m_ages[SETS][WAYS];
+    unsigned m_time = 0;
+public:
+    long long hits = 0;
+    long long accesses = 0;
+
+    CacheSimulator()
+    {
+        for(int set = 0; set < SETS; ++set) {
+            for(int way = 0; way < WAYS; ++way) {
+                m_tags[set][way] = ~static_cast<size_t>(0);
+                m_ages[set][way] = 0;
+            }
+        }
+    }
+
+    void access(const void *address)
+    {
+        size_t line = reinterpret_cast<size_t>(address) / LINE_SIZE;
+        int set = line % SETS;
+        ++accesses;
+        ++m_time;
+
+        int oldest = 0;
+        for(int way = 0; way < WAYS; ++way) {
+            if(m_tags[set][way] == line) {
+                ++hits;
+                m_ages[set][way] = m_time;
+                return;
+            }
+            if(m_ages[set][way] < m_ages[set][oldest])
+                oldest = way;
+        }
+        m_tags[set][oldest] = line;
+        m_ages[set][oldest] = m_time;
+    }
+};
+
+// Texture coordinates of every screen pixel, in raster block order, for the
+// texture rotated by angle around the screen center at one texel per pixel
+static void coordinates(float angle, std::vector<float>& us, std::vector<float>& vs)
+{
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    us.clear();
+    vs.clear();
+    for(int blockY = 0; blockY < SCREEN_SIZE; blockY += RASTER_BLOCK_SIZE) {
+        for(int blockX = 0; blockX < SCREEN_SIZE; blockX += RASTER_BLOCK_SIZE) {
+            for(int y = blockY; y < blockY + RASTER_BLOCK_SIZE; ++y) {
+                for(int x = blockX; x < blockX + RASTER_BLOCK_SIZE; ++x) {
+                    float px = x + 0.5f - SCREEN_SIZE / 2;
+                    float py = y + 0.5f - SCREEN_SIZE / 2;
+                    us.push_back((c * px - s * py) / TEXTURE_SIZE + 0.5f);
+                    vs.push_back((s * px + c * py) / TEXTURE_SIZE + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+static double hitRate(const Texture& texture, const std::vector<float>& us, const std::vector<float>& vs)
+{
+    const MipLevel& level = texture.level(0);
+    CacheSimulator cache;
+    for(size_t i = 0; i < us.size(); ++i) {
+        int u = static_cast<int>(us[i] * level.width) & level.widthMask;
+        int v = static_cast<int>(vs[i] * level.height) & level.heightMask;
+        cache.access(level.texels + Texture::texelIndex(texture.layout(), level, u, v));
+    }
+    return 100.0 * cache.hits / cache.accesses;
+}
+
+// Millions of samples per second through the batch sampler
+static double throughput(const Texture& texture, const std::vector<float>& us, const std::vector<float>& vs)
+{
+    const float lods[Texture::BATCH_SIZE] = {};
+    Color texels[Texture::BATCH_SIZE];
+    Uint32 checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int repetition = 0; repetition < REPETITIONS; ++repetition) {
+        for(size_t i = 0; i < us.size(); i += Texture::BATCH_SIZE) {
+            texture.sample(&us[i], &vs[i], lods, 0xff, texels);
+            checksum += texels[0].color();
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Keeps the compiler from dropping the sampling
+    if(checksum == 1)
+        std::printf(" ");
+    return us.size() * REPETITIONS / elapsed.count() / 1e6;
+}
+
+int main()
+{
+    std::vector<Color> texels(TEXTURE_SIZE * TEXTURE_SIZE);
+    Uint32 seed = 12345;
+    for(Color& texel : texels) {
+        seed = seed * 1664525 + 1013904223;
+        texel = Color::fromPacked(seed | 0xff);
+    }
+
+    Texture linear(TEXTURE_SIZE, TEXTURE_SIZE, texels.data());
+    Texture tiled(TEXTURE_SIZE, TEXTURE_SIZE, texels.data());
+    tiled.setLayout(TextureLayout::Tiled);
+
+    const TextureFilter filters[] = {TextureFilter::Nearest, TextureFilter::Bilinear};
+    const char *filterNames[] = {"nearest", "bilinear"};
+    const int angles[] = {0, 15, 30, 45, 60, 75, 90};
+
+    std::vector<float> us, vs;
+    std::printf("%5s  %-8s  %14s  %14s  %12s  %12s\n", "angle", "filter", "linear Ms/s", "tiled Ms/s", "linear hits", "tiled hits");
+    for(int angle : angles) {
+        coordinates(angle * 3.14159265f / 180.0f, us, vs);
+        double linearHits = hitRate(linear, us, vs);
+        double tiledHits = hitRate(tiled, us, vs);
+        for(int i = 0; i < 2; ++i) {
+            linear.setFilter(filters[i]);
+            tiled.setFilter(filters[i]);
+            std::printf("%5d  %-8s  %14.1f  %14.1f  %11.1f%%  %11.1f%%\n", angle, filterNames[i],
+                        throughput(linear, us, vs), throughput(tiled, us, vs), linearHits, tiledHits);
+        }
+    }
+    return 0;
+}
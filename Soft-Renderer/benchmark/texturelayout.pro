@@ -0,0 +1,31 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+CONFIG += c++11
+
+TARGET = texturelayout
+INCLUDEPATH += ..
+
+macx{
+LIBS += -L/usr/local/lib -lSDL2 -lSDL2_image
+INCLUDEPATH += /usr/local/include
+}
+
+win32{
+LIBS += C:\Libraries\SDL2_image-2.0.0\i686-w64-mingw32\lib\libSDL2_image.a \
+    C:\Libraries\SDL2-2.0.3\lib\x86\SDL2.lib
+INCLUDEPATH += C:\Libraries\SDL2-2.0.3\include \
+            C:\Libraries\glm
+}
+
+SOURCES += texturelayout.cpp \
+    ../texture.cpp \
+    ../blockcompression.cpp \
+    ../color.cpp
+
+HEADERS += \
+    ../texture.h \
+    ../blockcompression.h \
+    ../color.h \
+    ../simd.h
@@ -0,0 +1,188 @@
+#include "blockcompression.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace SoftEngine
+{
+static Uint16 readUint16(const Uint8 *bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static void writeUint16(Uint8 *bytes, Uint16 value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = value >> 8;
+}
+
+static Uint16 packRGB565(int red, int green, int blue)
+{
+    return ((red * 31 + 127) / 255 << 11) | ((green * 63 + 127) / 255 << 5) | ((blue * 31 + 127) / 255);
+}
+
+// Replicates the high bits in the low ones so 0 and the maximum map to 0 and 255
+static void unpackRGB565(Uint16 color, int *rgb)
+{
+    int red = color >> 11;
+    int green = (color >> 5) & 0x3f;
+    int blue = color & 0x1f;
+    rgb[0] = (red << 3) | (red >> 2);
+    rgb[1] = (green << 2) | (green >> 4);
+    rgb[2] = (blue << 3) | (blue >> 2);
+}
+
+// The four colors a BC1 block chooses from, or three and transparent black
+// when the first endpoint is not greater than the second
+static void colorPalette(Uint16 color0, Uint16 color1, bool allowTransparent, int palette[4][4])
+{
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for(int channel = 0; channel < 3; ++channel) {
+        if(color0 > color1 || !allowTransparent) {
+            palette[2][channel] = (2 * palette[0][channel] + palette[1][channel] + 1) / 3;
+            palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel] + 1) / 3;
+        } else {
+            palette[2][channel] = (palette[0][channel] + palette[1][channel] + 1) / 2;
+            palette[3][channel] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = color0 > color1 || !allowTransparent ? 255 : 0;
+}
+
+static void alphaPalette(int alpha0, int alpha1, int palette[8])
+{
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if(alpha0 > alpha1) {
+        for(int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * alpha0 + i * alpha1 + 3) / 7;
+    } else {
+        for(int i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * alpha0 + i * alpha1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Endpoints are the corners of the colors' bounding box, pulled in by a sixteenth
+// of its size, each texel then picks the closest of the four palette colors
+static void encodeColors(const Color *texels, Uint8 *block)
+{
+    int minimum[3] = {255, 255, 255};
+    int maximum[3] = {0, 0, 0};
+    for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+        int rgb[3] = {static_cast<int>(texels[i].r()), static_cast<int>(texels[i].g()), static_cast<int>(texels[i].b())};
+        for(int channel = 0; channel < 3; ++channel) {
+            minimum[channel] = std::min(minimum[channel], rgb[channel]);
+            maximum[channel] = std::max(maximum[channel], rgb[channel]);
+        }
+    }
+    for(int channel = 0; channel < 3; ++channel) {
+        int inset = (maximum[channel] - minimum[channel]) / 16;
+        minimum[channel] += inset;
+        maximum[channel] -= inset;
+    }
+
+    Uint16 color0 = packRGB565(maximum[0], maximum[1], maximum[2]);
+    Uint16 color1 = packRGB565(minimum[0], minimum[1], minimum[2]);
+    writeUint16(block, color0);
+    writeUint16(block + 2, color1);
+
+    Uint32 indices = 0;
+    if(color0 > color1) {
+        int palette[4][4];
+        colorPalette(color0, color1, false, palette);
+        for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+            int rgb[3] = {static_cast<int>(texels[i].r()), static_cast<int>(texels[i].g()), static_cast<int>(texels[i].b())};
+            int best = 0;
+            int bestDistance = INT_MAX;
+            for(int entry = 0; entry < 4; ++entry) {
+                int distance = 0;
+                for(int channel = 0; channel < 3; ++channel)
+                    distance += (rgb[channel] - palette[entry][channel]) * (rgb[channel] - palette[entry][channel]);
+                if(distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            indices |= static_cast<Uint32>(best) << (2 * i);
+        }
+    }
+    // Equal endpoints leave every index on the first one
+    for(int i = 0; i < 4; ++i)
+        block[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void encodeBC1(const Color *texels, Uint8 *block)
+{
+    encodeColors(texels, block);
+}
+
+void encodeBC3(const Color *texels, Uint8 *block)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+        alpha0 = std::max(alpha0, static_cast<int>(texels[i].a()));
+        alpha1 = std::min(alpha1, static_cast<int>(texels[i].a()));
+    }
+    block[0] = alpha0;
+    block[1] = alpha1;
+
+    Uint64 indices = 0;
+    if(alpha0 > alpha1) {
+        int palette[8];
+        alphaPalette(alpha0, alpha1, palette);
+        for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+            int alpha = texels[i].a();
+            int best = 0;
+            for(int entry = 1; entry < 8; ++entry) {
+                if(std::abs(alpha - palette[entry]) < std::abs(alpha - palette[best]))
+                    best = entry;
+            }
+            indices |= static_cast<Uint64>(best) << (3 * i);
+        }
+    }
+    for(int i = 0; i < 6; ++i)
+        block[2 + i] = (indices >> (8 * i)) & 0xff;
+
+    encodeColors(texels, block + 8);
+}
+
+static void decodeColors(const Uint8 *block, bool allowTransparent, Color *texels)
+{
+    int palette[4][4];
+    colorPalette(readUint16(block), readUint16(block + 2), allowTransparent, palette);
+
+    Uint32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<Uint32>(block[7]) << 24);
+    for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+        const int *color = palette[(indices >> (2 * i)) & 3];
+        texels[i] = Color::fromPacked((color[0] << 24) | (color[1] << 16) | (color[2] << 8) | color[3]);
+    }
+}
+
+void decodeBC1(const Uint8 *block, Color *texels)
+{
+    decodeColors(block, true, texels);
+}
+
+void decodeBC3(const Uint8 *block, Color *texels)
+{
+    // BC3 colors always use the four color palette
+    decodeColors(block + 8, false, texels);
+
+    int palette[8];
+    alphaPalette(block[0], block[1], palette);
+    Uint64 indices = 0;
+    for(int i = 0; i < 6; ++i)
+        indices |= static_cast<Uint64>(block[2 + i]) << (8 * i);
+    for(int i = 0; i < COMPRESSED_BLOCK_TEXELS; ++i) {
+        Uint32 color = texels[i].color() & 0xffffff00;
+        texels[i] = Color::fromPacked(color | palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+}// end of namespace
@@ -0,0 +1,26 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include "SDL2/SDL_stdinc.h"
+#include "color.h"
+
+namespace SoftEngine
+{
+// BC1 (DXT1) and BC3 (DXT5) encoding and decoding of 4x4 texel blocks.
+// Texels are given row after row.
+
+static const int COMPRESSED_BLOCK_SIZE = 4;
+static const int COMPRESSED_BLOCK_TEXELS = COMPRESSED_BLOCK_SIZE * COMPRESSED_BLOCK_SIZE;
+static const int BC1_BLOCK_BYTES = 8;
+static const int BC3_BLOCK_BYTES = 16;
+
+// Opaque colors, alpha is dropped
+void encodeBC1(const Color *texels, Uint8 *block);
+// Colors like BC1 followed by an interpolated alpha block
+void encodeBC3(const Color *texels, Uint8 *block);
+
+void decodeBC1(const Uint8 *block, Color *texels);
+void decodeBC3(const Uint8 *block, Color *texels);
+}// end of namespace
+
+#endif // BLOCKCOMPRESSION_H
@@ -1,4 +1,8 @@
 #include "color.h"
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace SoftEngine
 {
@@ -52,4 +56,150 @@ Color operator*(const Color& lhs, const Color& rhs)
     return Color(ired, igreen, iblue, lhs.a());
 }
 
+// The span versions work on four colors at a time, each channel widened to
+// 16 bits so products of two channels fit, and finish the rest one by one.
+#if defined(__SSE2__)
+static_assert(sizeof(Color) == sizeof(Uint32), "Colors are processed as packed 32 bit values");
+
+static inline __m128i load4(const Color *colors)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors));
+}
+
+static inline void store4(Color *colors, __m128i value)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(colors), value);
+}
+
+// Same rounding as div255(Uint32) on eight 16 bit channels
+static inline __m128i div255(__m128i value)
+{
+    __m128i t = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Four bytes, one per color, repeated over the four channels of the low and high two colors
+static inline void broadcast4(const Uint8 *bytes, __m128i& low, __m128i& high)
+{
+    int packed;
+    std::memcpy(&packed, bytes, sizeof(packed));
+    __m128i value = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), _mm_setzero_si128());
+    value = _mm_unpacklo_epi16(value, value);
+    low = _mm_unpacklo_epi32(value, value);
+    high = _mm_unpackhi_epi32(value, value);
+}
+
+static inline __m128i lerp2(__m128i from, __m128i to, __m128i weight)
+{
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), weight);
+    return div255(_mm_add_epi16(_mm_mullo_epi16(from, inverse), _mm_mullo_epi16(to, weight)));
+}
+#endif
+
+void modulate(Color *destination, const Color *lhs, const Color *rhs, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4) {
+        __m128i l = load4(lhs + i);
+        __m128i r = load4(rhs + i);
+        __m128i low = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(r, zero)));
+        __m128i high = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(r, zero)));
+        store4(destination + i, _mm_packus_epi16(low, high));
+    }
+#endif
+    for(; i < count; ++i)
+        destination[i] = modulate(lhs[i], rhs[i]);
+}
+
+void modulate(Color *destination, const Color *source, Color color, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color.color())), zero);
+    for(; i + 4 <= count; i += 4) {
+        __m128i s = load4(source + i);
+        __m128i low = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), c));
+        __m128i high = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), c));
+        store4(destination + i, _mm_packus_epi16(low, high));
+    }
+#endif
+    for(; i < count; ++i)
+        destination[i] = modulate(source[i], color);
+}
+
+void scale(Color *destination, const Color *source, const Uint8 *factors, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    // Alpha is the lowest byte, scaling it by 255 keeps it unchanged
+    const __m128i alpha = _mm_setr_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    for(; i + 4 <= count; i += 4) {
+        __m128i s = load4(source + i);
+        __m128i factorLow, factorHigh;
+        broadcast4(factors + i, factorLow, factorHigh);
+        __m128i low = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_or_si128(factorLow, alpha)));
+        __m128i high = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_or_si128(factorHigh, alpha)));
+        store4(destination + i, _mm_packus_epi16(low, high));
+    }
+#endif
+    for(; i < count; ++i)
+        destination[i] = scale(source[i], factors[i]);
+}
+
+void add(Color *destination, const Color *lhs, const Color *rhs, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for(; i + 4 <= count; i += 4)
+        store4(destination + i, _mm_adds_epu8(load4(lhs + i), load4(rhs + i)));
+#endif
+    for(; i < count; ++i)
+        destination[i] = add(lhs[i], rhs[i]);
+}
+
+void lerp(Color *destination, const Color *from, const Color *to, const Uint8 *weights, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4) {
+        __m128i f = load4(from + i);
+        __m128i t = load4(to + i);
+        __m128i weightLow, weightHigh;
+        broadcast4(weights + i, weightLow, weightHigh);
+        __m128i low = lerp2(_mm_unpacklo_epi8(f, zero), _mm_unpacklo_epi8(t, zero), weightLow);
+        __m128i high = lerp2(_mm_unpackhi_epi8(f, zero), _mm_unpackhi_epi8(t, zero), weightHigh);
+        store4(destination + i, _mm_packus_epi16(low, high));
+    }
+#endif
+    for(; i < count; ++i)
+        destination[i] = lerp(from[i], to[i], weights[i]);
+}
+
+void blend(Color *destination, const Color *source, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4) {
+        __m128i d = load4(destination + i);
+        __m128i s = load4(source + i);
+        __m128i sourceLow = _mm_unpacklo_epi8(s, zero);
+        __m128i sourceHigh = _mm_unpackhi_epi8(s, zero);
+        // Spread the alpha of every color over its four channels
+        __m128i alphaLow = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sourceLow, 0), 0);
+        __m128i alphaHigh = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sourceHigh, 0), 0);
+        __m128i low = lerp2(_mm_unpacklo_epi8(d, zero), sourceLow, alphaLow);
+        __m128i high = lerp2(_mm_unpackhi_epi8(d, zero), sourceHigh, alphaHigh);
+        store4(destination + i, _mm_packus_epi16(low, high));
+    }
+#endif
+    for(; i < count; ++i)
+        destination[i] = blend(destination[i], source[i]);
+}
+
 }// end of namespace
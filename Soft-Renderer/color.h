@@ -75,6 +75,14 @@ public:
         return m_color;
     }
 
+    // Packed 0xRRGGBBAA value, taken as is without clamping the channels
+    static Color fromPacked(Uint32 color)
+    {
+        Color result;
+        result.m_color = color;
+        return result;
+    }
+
     static const Color Red;
     static const Color Green;
     static const Color Blue;
@@ -85,6 +93,82 @@ public:
 Color operator*(const Color& lhs, const Color& rhs);
 Color operator*(const Color& color, float scalar);
 
+// Fixed point color math. Channels are treated as values in [0, 1] and products
+// are rounded to the nearest 8 bit value, so no result ever needs clamping.
+
+// value / 255 rounded, for values up to 255 * 255
+inline Uint32 div255(Uint32 value)
+{
+    Uint32 t = value + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+inline Uint32 mulDiv255(Uint32 a, Uint32 b)
+{
+    return div255(a * b);
+}
+
+// Every channel of lhs multiplied by the same channel of rhs
+inline Color modulate(const Color& lhs, const Color& rhs)
+{
+    Uint32 l = lhs.color();
+    Uint32 r = rhs.color();
+    return Color::fromPacked((mulDiv255(l >> 24, r >> 24) << 24)
+                             | (mulDiv255((l >> 16) & 0xff, (r >> 16) & 0xff) << 16)
+                             | (mulDiv255((l >> 8) & 0xff, (r >> 8) & 0xff) << 8)
+                             | mulDiv255(l & 0xff, r & 0xff));
+}
+
+// Red, green and blue multiplied by factor / 255, alpha kept like operator*(Color, float) does
+inline Color scale(const Color& color, Uint8 factor)
+{
+    Uint32 c = color.color();
+    return Color::fromPacked((mulDiv255(c >> 24, factor) << 24)
+                             | (mulDiv255((c >> 16) & 0xff, factor) << 16)
+                             | (mulDiv255((c >> 8) & 0xff, factor) << 8)
+                             | (c & 0xff));
+}
+
+// Channels added, saturating at 255
+inline Color add(const Color& lhs, const Color& rhs)
+{
+    Uint32 l = lhs.color();
+    Uint32 r = rhs.color();
+    Uint32 result = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        Uint32 sum = ((l >> shift) & 0xff) + ((r >> shift) & 0xff);
+        result |= (sum > 255 ? 255 : sum) << shift;
+    }
+    return Color::fromPacked(result);
+}
+
+// from + (to - from) * weight / 255 for every channel
+inline Color lerp(const Color& from, const Color& to, Uint8 weight)
+{
+    Uint32 f = from.color();
+    Uint32 t = to.color();
+    Uint32 result = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        Uint32 channel = div255(((f >> shift) & 0xff) * (255 - weight) + ((t >> shift) & 0xff) * weight);
+        result |= channel << shift;
+    }
+    return Color::fromPacked(result);
+}
+
+// source over destination, weighted by the source alpha
+inline Color blend(const Color& destination, const Color& source)
+{
+    return lerp(destination, source, source.a());
+}
+
+// The same operations over spans of count colors. destination may alias any of the sources.
+void modulate(Color *destination, const Color *lhs, const Color *rhs, int count);
+void modulate(Color *destination, const Color *source, Color color, int count);
+void scale(Color *destination, const Color *source, const Uint8 *factors, int count);
+void add(Color *destination, const Color *lhs, const Color *rhs, int count);
+void lerp(Color *destination, const Color *from, const Color *to, const Uint8 *weights, int count);
+void blend(Color *destination, const Color *source, int count);
+
 std::ostream& operator<<(std::ostream& out, const Color& color);
 
 }//end of namespace
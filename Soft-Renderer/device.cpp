@@ -3,14 +3,17 @@
 #include "glm/gtx/euler_angles.hpp"
 #include "glm/ext.hpp"
 #include "glm/gtx/normalize_dot.hpp"
-#include "json/json.h"
+#include "babylonloader.h"
+#include "meshoptimizer.h"
+#include "scenefile.h"
+#include "simd.h"
 #include <algorithm>
 #include <cmath>
-#include <fstream>
 #include <string>
 #include <iostream>
 #include <climits>
-#include <unordered_map>
+#include <cstring>
+#include <fstream>
 #include <utility>
 
 //#include <omp.h>
@@ -58,27 +61,152 @@ static glm::mat4 perspectiveFovLH(float fovy, float aspect, float znear, float z
 namespace SoftEngine
 {
 
+// Some of the constants are passed by reference, to std::min among others
+const int Device::TILE_SIZE;
+const int Device::BLOCK_SIZE;
+const Uint32 Device::NO_TRIANGLE;
+
+// The buffers are sized for whole blocks so the tiled layout can store the partial ones on the right and bottom edges
 Device::Device(int width, int height)
-    : m_width(width), m_height(height), m_back_buffer(new Color[width * height]), m_depthBuffer(new float[width * height])
+    : m_width(width), m_height(height),
+      m_blocksX((width + BLOCK_SIZE - 1) / BLOCK_SIZE), m_blocksY((height + BLOCK_SIZE - 1) / BLOCK_SIZE),
+      m_bufferSize(m_blocksX * m_blocksY * BLOCK_SIZE * BLOCK_SIZE),
+      m_back_buffer(new Color[m_bufferSize]), m_depthBuffer(new float[m_bufferSize]),
+      m_visibilityBuffer(new Uint32[m_bufferSize]), m_resolveBuffer(new Color[width * height]),
+      m_tilesX((width + TILE_SIZE - 1) / TILE_SIZE), m_tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+      m_tileBins(m_tilesX * m_tilesY), m_tileInitialized(m_tilesX * m_tilesY, 0),
+      m_blockDepth(m_blocksX * m_blocksY, std::numeric_limits<float>::max())
 {}
 
 Device::~Device()
 {
     delete [] m_back_buffer;
     delete [] m_depthBuffer;
+    delete [] m_visibilityBuffer;
+    delete [] m_resolveBuffer;
 }
 
+// Tiles are only written when something is first drawn into them, or by resolve() for the ones left untouched
 void Device::clear(const Color color)
 {
-    for(int i = 0; i < m_width * m_height; ++i) {
-        m_back_buffer[i] = color;
-        m_depthBuffer[i] = std::numeric_limits<float>::max();
+    m_clearColor = color;
+    m_layout = m_pendingLayout;
+    std::fill(m_tileInitialized.begin(), m_tileInitialized.end(), 0);
+}
+
+ClipRect Device::tileRect(int tile) const
+{
+    int tileX = (tile % m_tilesX) * TILE_SIZE;
+    int tileY = (tile / m_tilesX) * TILE_SIZE;
+    ClipRect rect = {tileX, tileY, std::min(tileX + TILE_SIZE, m_width), std::min(tileY + TILE_SIZE, m_height)};
+    return rect;
+}
+
+void Device::initializeTile(int tile)
+{
+    if(m_tileInitialized[tile])
+        return;
+    m_tileInitialized[tile] = 1;
+
+    ClipRect rect = this->tileRect(tile);
+    for(int y = rect.minY; y < rect.maxY; ++y) {
+        for(int x = rect.minX; x < rect.maxX; x += BLOCK_SIZE) {
+            int index = this->pixelIndex(x, y);
+            int count = std::min(BLOCK_SIZE, rect.maxX - x);
+            std::fill(m_back_buffer + index, m_back_buffer + index + count, m_clearColor);
+            std::fill(m_depthBuffer + index, m_depthBuffer + index + count, std::numeric_limits<float>::max());
+        }
+    }
+    for(int blockY = rect.minY / BLOCK_SIZE; blockY * BLOCK_SIZE < rect.maxY; ++blockY)
+        for(int blockX = rect.minX / BLOCK_SIZE; blockX * BLOCK_SIZE < rect.maxX; ++blockX)
+            m_blockDepth[blockX + blockY * m_blocksX] = std::numeric_limits<float>::max();
+}
+
+void Device::initializeTiles(const ClipRect& rect)
+{
+    for(int tileY = rect.minY / TILE_SIZE; tileY * TILE_SIZE < rect.maxY; ++tileY)
+        for(int tileX = rect.minX / TILE_SIZE; tileX * TILE_SIZE < rect.maxX; ++tileX)
+            this->initializeTile(tileX + tileY * m_tilesX);
+}
+
+void Device::updateBlockDepth(int blockX, int blockY)
+{
+    int x = blockX * BLOCK_SIZE;
+    int y = blockY * BLOCK_SIZE;
+    int endX = std::min(x + BLOCK_SIZE, m_width);
+    int endY = std::min(y + BLOCK_SIZE, m_height);
+
+    float farthest;
+    // A full block row is exactly one Float8
+    static_assert(BLOCK_SIZE == 8, "block rows must match the Float8 width");
+    if(endX - x == BLOCK_SIZE) {
+        Float8 rows = Float8::load(m_depthBuffer + this->pixelIndex(x, y));
+        for(int row = y + 1; row < endY; ++row)
+            rows = max(rows, Float8::load(m_depthBuffer + this->pixelIndex(x, row)));
+        alignas(32) float lanes[BLOCK_SIZE];
+        rows.store(lanes);
+        farthest = *std::max_element(lanes, lanes + BLOCK_SIZE);
+    } else {
+        farthest = -std::numeric_limits<float>::max();
+        for(int row = y; row < endY; ++row)
+            for(int column = x; column < endX; ++column)
+                farthest = std::max(farthest, m_depthBuffer[this->pixelIndex(column, row)]);
+    }
+    m_blockDepth[blockX + blockY * m_blocksX] = farthest;
+}
+
+bool Device::isOccluded(const TriangleSetup& setup, const ClipRect& clip) const
+{
+    int minX = std::max(setup.minX, clip.minX) / BLOCK_SIZE;
+    int minY = std::max(setup.minY, clip.minY) / BLOCK_SIZE;
+    int maxX = std::min(setup.maxX, clip.maxX - 1) / BLOCK_SIZE;
+    int maxY = std::min(setup.maxY, clip.maxY - 1) / BLOCK_SIZE;
+
+    for(int blockY = minY; blockY <= maxY; ++blockY) {
+        for(int blockX = minX; blockX <= maxX; ++blockX) {
+            if(setup.minZ <= m_blockDepth[blockX + blockY * m_blocksX])
+                return false;
+        }
+    }
+    return true;
+}
+
+void Device::resolve()
+{
+    Color *target = this->backBuffer();
+    const int tilesCount = m_tilesX * m_tilesY;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int tile = 0; tile < tilesCount; ++tile) {
+        ClipRect rect = this->tileRect(tile);
+        int width = rect.maxX - rect.minX;
+
+        // Nothing was drawn in the tile since the last clear
+        if(!m_tileInitialized[tile]) {
+            for(int y = rect.minY; y < rect.maxY; ++y)
+                std::fill(target + rect.minX + y * m_width, target + rect.maxX + y * m_width, m_clearColor);
+            continue;
+        }
+        if(m_layout == FramebufferLayout::Linear)
+            continue;
+
+        // Every block row of the tiled buffer becomes BLOCK_SIZE rows of the linear one
+        for(int y = rect.minY; y < rect.maxY; ++y) {
+            const Color *source = m_back_buffer + this->pixelIndex(rect.minX, y);
+            Color *destination = target + rect.minX + y * m_width;
+            for(int x = 0; x < width; x += BLOCK_SIZE) {
+                int count = std::min(BLOCK_SIZE, width - x);
+                std::copy(source, source + count, destination + x);
+                source += BLOCK_SIZE * BLOCK_SIZE;
+            }
+        }
     }
 }
 
 void Device::putPixel(int x, int y, float z, const Color color)
 {
-    int index = (x + y * m_width);
+    this->initializeTile(x / TILE_SIZE + (y / TILE_SIZE) * m_tilesX);
+    int index = this->pixelIndex(x, y);
 
 
     if(m_depthBuffer[index] < z)
@@ -135,356 +263,911 @@ void Device::drawBLine(glm::vec3 start, glm::vec3 end, Color color)
     }
 }
 
-void Device::proccessScanLine(ScanLineData data, Vertex& va, Vertex& vb, Vertex& vc, Vertex& vd, Color color, const Texture& texture)
+static AttributePlane computePlane(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+                                   float a0, float a1, float a2, float invArea)
 {
-    glm::vec3& v1 = va.coordinates;
-    glm::vec3& v2 = vb.coordinates;
-    glm::vec3& v3 = vc.coordinates;
-    glm::vec3& v4 = vd.coordinates;
+    float d1 = a1 - a0;
+    float d2 = a2 - a0;
+
+    AttributePlane plane;
+    plane.dx = (d1 * (p2.y - p0.y) - d2 * (p1.y - p0.y)) * invArea;
+    plane.dy = (d2 * (p1.x - p0.x) - d1 * (p2.x - p0.x)) * invArea;
+    plane.c = a0 - plane.dx * p0.x - plane.dy * p0.y;
+    return plane;
+}
 
-    auto gradient1 = v1.y != v2.y ? (data.currentY - v1.y) / (v2.y - v1.y) : 1;
-    auto gradient2 = v3.y != v4.y ? (data.currentY - v3.y) / (v4.y - v3.y) : 1;
+static bool setupTriangle(const ScreenVertex& va, const ScreenVertex& vb, const ScreenVertex& vc, TriangleSetup& setup)
+{
+    const ScreenVertex *v0 = &va;
+    const ScreenVertex *v1 = &vb;
+    const ScreenVertex *v2 = &vc;
+
+    float area = (v1->position.x - v0->position.x) * (v2->position.y - v0->position.y)
+            - (v1->position.y - v0->position.y) * (v2->position.x - v0->position.x);
+    if(area == 0.0f)
+        return false;
+    if(area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
 
-    int sx = static_cast<int>(glm::mix(v1.x, v2.x, gradient1));
-    int ex = static_cast<int>(glm::mix(v3.x, v4.x, gradient2));
+    const glm::vec3& p0 = v0->position;
+    const glm::vec3& p1 = v1->position;
+    const glm::vec3& p2 = v2->position;
+
+    setup.minX = static_cast<int>(std::floor(std::min(p0.x, std::min(p1.x, p2.x))));
+    setup.minY = static_cast<int>(std::floor(std::min(p0.y, std::min(p1.y, p2.y))));
+    setup.maxX = static_cast<int>(std::ceil(std::max(p0.x, std::max(p1.x, p2.x))));
+    setup.maxY = static_cast<int>(std::ceil(std::max(p0.y, std::max(p1.y, p2.y))));
+    setup.minZ = std::min(p0.z, std::min(p1.z, p2.z));
+
+    setup.top = glm::vec2(p0.x, p0.y);
+    setup.middle = glm::vec2(p1.x, p1.y);
+    setup.bottom = glm::vec2(p2.x, p2.y);
+    if(setup.top.y > setup.middle.y) std::swap(setup.top, setup.middle);
+    if(setup.middle.y > setup.bottom.y) std::swap(setup.middle, setup.bottom);
+    if(setup.top.y > setup.middle.y) std::swap(setup.top, setup.middle);
+    float longEdgeX = glm::mix(setup.top.x, setup.bottom.x, (setup.middle.y - setup.top.y) / (setup.bottom.y - setup.top.y));
+    setup.longEdgeLeft = longEdgeX < setup.middle.x;
+
+    // Edge functions E(x, y) = a * x + b * y + c, positive inside the triangle.
+    // Edge i is the one opposite to vertex i.
+    const glm::vec3* from[3] = {&p1, &p2, &p0};
+    const glm::vec3* to[3] = {&p2, &p0, &p1};
+    for(int i = 0; i < 3; ++i) {
+        float dx = to[i]->x - from[i]->x;
+        float dy = to[i]->y - from[i]->y;
+        setup.edgeA[i] = -dy;
+        setup.edgeB[i] = dx;
+        setup.edgeC[i] = dy * from[i]->x - dx * from[i]->y;
+        // Top-left fill rule : pixels exactly on a top or left edge belong to the triangle
+        bool topLeft = dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+        setup.threshold[i] = topLeft ? -std::numeric_limits<float>::min() : 0.0f;
+    }
 
-    float z1 = glm::mix(v1.z, v2.z, gradient1);
-    float z2 = glm::mix(v3.z, v4.z, gradient2);
+    // Depth and lighting are interpolated linearly in screen space, texture
+    // coordinates are divided by w so they can be interpolated perspective correct.
+    float invArea = 1.0f / area;
+    float w0 = v0->inverseW;
+    float w1 = v1->inverseW;
+    float w2 = v2->inverseW;
+    setup.z = computePlane(p0, p1, p2, p0.z, p1.z, p2.z, invArea);
+    setup.ndotl = computePlane(p0, p1, p2, v0->ndotl, v1->ndotl, v2->ndotl, invArea);
+    setup.inverseW = computePlane(p0, p1, p2, w0, w1, w2, invArea);
+    setup.uOverW = computePlane(p0, p1, p2, v0->textureCoordinates.x * w0, v1->textureCoordinates.x * w1, v2->textureCoordinates.x * w2, invArea);
+    setup.vOverW = computePlane(p0, p1, p2, v0->textureCoordinates.y * w0, v1->textureCoordinates.y * w1, v2->textureCoordinates.y * w2, invArea);
+
+    return true;
+}
 
-    float snl = glm::mix(data.ndotla, data.ndotlb, gradient1);
-    float enl = glm::mix(data.ndotlc, data.ndotld, gradient2);
+// N.L as the 8 bit factor the texels get scaled by
+static inline Uint8 lightFactor(float ndotl)
+{
+    return static_cast<Uint8>(glm::clamp(ndotl, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
 
-    float su = glm::mix(data.ua, data.ub, gradient1);
-    float eu = glm::mix(data.uc, data.ud, gradient2);
-    float sv = glm::mix(data.va, data.vb, gradient1);
-    float ev = glm::mix(data.vc, data.vd, gradient2);
+// Level of detail of the 2x2 pixel quad whose top left sample is at (x, y) :
+// the log2 of the longest texel step between neighbouring samples of the quad
+static float quadLod(const TriangleSetup& setup, const Texture& texture, float x, float y)
+{
+    float w00 = 1.0f / setup.inverseW.at(x, y);
+    float w10 = 1.0f / setup.inverseW.at(x + 1.0f, y);
+    float w01 = 1.0f / setup.inverseW.at(x, y + 1.0f);
+    float u00 = setup.uOverW.at(x, y) * w00;
+    float v00 = setup.vOverW.at(x, y) * w00;
+
+    float dudx = (setup.uOverW.at(x + 1.0f, y) * w10 - u00) * texture.width();
+    float dvdx = (setup.vOverW.at(x + 1.0f, y) * w10 - v00) * texture.height();
+    float dudy = (setup.uOverW.at(x, y + 1.0f) * w01 - u00) * texture.width();
+    float dvdy = (setup.vOverW.at(x, y + 1.0f) * w01 - v00) * texture.height();
+
+    float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    return 0.5f * std::log2(rho2);
+}
 
-    for(int x = sx; x < ex; ++x) {
-        float gradient = (x - sx) / static_cast<float>(ex - sx);
-        float ndotl = glm::mix(snl, enl, gradient);
-        float u = glm::mix(su, eu, gradient);
-        float v = glm::mix(sv, ev, gradient);
-        float z = glm::mix(z1, z2, gradient);
-        Color textureColor;
-        textureColor = texture.map(u, v);
-        this->drawPoint(glm::vec3(x, data.currentY, z), operator*(color, (textureColor * ndotl)));
+template<PixelOutput output>
+void Device::proccessScanLine(int y, const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id)
+{
+    const glm::vec2& top = setup.top;
+    const glm::vec2& middle = setup.middle;
+    const glm::vec2& bottom = setup.bottom;
+
+    float longGradient = top.y != bottom.y ? (y - top.y) / (bottom.y - top.y) : 1;
+    float longX = glm::mix(top.x, bottom.x, longGradient);
+    float shortX;
+    if(y < middle.y) {
+        float gradient = top.y != middle.y ? (y - top.y) / (middle.y - top.y) : 1;
+        shortX = glm::mix(top.x, middle.x, gradient);
+    } else {
+        float gradient = middle.y != bottom.y ? (y - middle.y) / (bottom.y - middle.y) : 1;
+        shortX = glm::mix(middle.x, bottom.x, gradient);
+    }
+
+    int sx = static_cast<int>(setup.longEdgeLeft ? longX : shortX);
+    int ex = static_cast<int>(setup.longEdgeLeft ? shortX : longX);
+    int startX = std::max(sx, clip.minX);
+    int endX = std::min(ex, clip.maxX);
+    if(startX >= endX)
+        return;
+
+    float z = setup.z.at(startX, y);
+    float ndotl = setup.ndotl.at(startX, y);
+    float inverseW = setup.inverseW.at(startX, y);
+    float uOverW = setup.uOverW.at(startX, y);
+    float vOverW = setup.vOverW.at(startX, y);
+
+    int row = this->rowIndex(y);
+    float lod = 0.0f;
+    for(int x = startX; x < endX; ++x) {
+        int index = row + this->columnOffset(x);
+        bool visible = output == PixelOutput::EqualDepth ? z == m_depthBuffer[index] : z <= m_depthBuffer[index];
+        if(visible) {
+            if(output != PixelOutput::EqualDepth)
+                m_depthBuffer[index] = z;
+            if(output == PixelOutput::Visibility) {
+                m_visibilityBuffer[index] = id;
+            } else if(output != PixelOutput::DepthOnly) {
+                float w = 1.0f / inverseW;
+                if(x == startX || !(x & 1))
+                    lod = quadLod(setup, texture, x & ~1, y & ~1);
+                Color textureColor = texture.sample(uOverW * w, vOverW * w, lod);
+                m_back_buffer[index] = modulate(scale(textureColor, lightFactor(ndotl)), color);
+            }
+        }
+        z += setup.z.dx;
+        ndotl += setup.ndotl.dx;
+        inverseW += setup.inverseW.dx;
+        uOverW += setup.uOverW.dx;
+        vOverW += setup.vOverW.dx;
     }
 }
 
-float computeNDotL(glm::vec3& vertex, glm::vec3& normal, glm::vec3& light)
+void Device::drawTriangle(const ScreenVertex& v1, const ScreenVertex& v2, const ScreenVertex& v3, Color color, const Texture& texture)
 {
-    auto lightDirection = light - vertex;
-    return glm::max(0.0f, glm::normalizeDot(normal, lightDirection));
+    TriangleSetup setup;
+    if(!setupTriangle(v1, v2, v3, setup))
+        return;
+
+    ClipRect screen = {0, 0, m_width, m_height};
+    ClipRect bounds = {std::max(setup.minX, 0), std::max(setup.minY, 0),
+                       std::min(setup.maxX + 1, m_width), std::min(setup.maxY + 1, m_height)};
+    this->initializeTiles(bounds);
+    if(m_rasterizer == RasterizerType::HalfSpace)
+        this->drawTriangleHalfSpace<PixelOutput::Shaded>(setup, color, texture, screen, 0);
+    else
+        this->drawTriangle<PixelOutput::Shaded>(setup, color, texture, screen, 0);
 }
 
-void Device::drawTriangle(Vertex vv1, Vertex vv2, Vertex vv3, Color color, const Texture& texture)
+template<PixelOutput output>
+void Device::drawTriangle(const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id)
 {
-    if(vv1.coordinates.y > vv2.coordinates.y) std::swap(vv1, vv2);
-    if(vv2.coordinates.y > vv3.coordinates.y) std::swap(vv2, vv3);
-    if(vv1.coordinates.y > vv2.coordinates.y) std::swap(vv1, vv2);
+    // Only walk the scanlines which fall inside the clip rectangle
+    int startY = std::max(static_cast<int>(setup.top.y), clip.minY);
+    int endY = std::min(static_cast<int>(std::floor(setup.bottom.y)), clip.maxY - 1);
 
-    glm::vec3& v1 = vv1.coordinates;
-    glm::vec3& v2 = vv2.coordinates;
-    glm::vec3& v3 = vv3.coordinates;
+    for(int y = startY; y <= endY; ++y) {
+        this->proccessScanLine<output>(y, setup, color, texture, clip, id);
+    }
 
-    glm::vec3 lightPos(0, 10, -10);
+    // The shading pass of the depth pre-pass leaves the depth untouched
+    if(output == PixelOutput::EqualDepth)
+        return;
 
-    float nl1 = computeNDotL(vv1.worldCoordinates, vv1.normal, lightPos);
-    float nl2 = computeNDotL(vv2.worldCoordinates, vv2.normal, lightPos);
-    float nl3 = computeNDotL(vv3.worldCoordinates, vv3.normal, lightPos);
+    int minX = std::max(setup.minX, clip.minX) / BLOCK_SIZE;
+    int maxX = std::min(setup.maxX, clip.maxX - 1) / BLOCK_SIZE;
+    for(int blockY = startY / BLOCK_SIZE; blockY <= endY / BLOCK_SIZE; ++blockY)
+        for(int blockX = minX; blockX <= maxX; ++blockX)
+            this->updateBlockDepth(blockX, blockY);
+}
 
-    ScanLineData data;
+template<PixelOutput output>
+void Device::drawTriangleHalfSpace(const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id)
+{
+    int minX = std::max(setup.minX, clip.minX);
+    int minY = std::max(setup.minY, clip.minY);
+    int maxX = std::min(setup.maxX, clip.maxX - 1);
+    int maxY = std::min(setup.maxY, clip.maxY - 1);
+    if(minX > maxX || minY > maxY)
+        return;
 
-    float dV1V2;
-    float dV1V3;
-    if(v2.y - v1.y > 0)
-        dV1V2 = (v2.x - v1.x) / (v2.y - v1.y);
-    else
-        dV1V2 = 0;
-    if(v3.y - v1.y > 0)
-        dV1V3 = (v3.x - v1.x) / (v3.y - v1.y);
-    else
-        dV1V3 = 0;
-
-    if(dV1V2 > dV1V3) {
-        for(int y = v1.y; y <= v3.y; ++y) {
-            data.currentY = y;
-            if(y < v2.y) {
-                data.ndotla = nl1;
-                data.ndotlb = nl3;
-                data.ndotlc = nl1;
-                data.ndotld = nl2;
-                data.ua = vv1.textureCoordinates.x;
-                data.va = vv1.textureCoordinates.y;
-                data.ub = vv3.textureCoordinates.x;
-                data.vb = vv3.textureCoordinates.y;
-                data.uc = vv1.textureCoordinates.x;
-                data.vc = vv1.textureCoordinates.y;
-                data.ud = vv2.textureCoordinates.x;
-                data.vd = vv2.textureCoordinates.y;
-                this->proccessScanLine(data, vv1, vv3, vv1, vv2, color, texture);
-            } else {
-                data.ndotla = nl1;
-                data.ndotlb = nl3;
-                data.ndotlc = nl2;
-                data.ndotld = nl3;
-                data.ua = vv1.textureCoordinates.x;
-                data.va = vv1.textureCoordinates.y;
-                data.ub = vv3.textureCoordinates.x;
-                data.vb = vv3.textureCoordinates.y;
-                data.uc = vv2.textureCoordinates.x;
-                data.vc = vv2.textureCoordinates.y;
-                data.ud = vv3.textureCoordinates.x;
-                data.vd = vv3.textureCoordinates.y;
-                this->proccessScanLine(data, vv1, vv3, vv2, vv3, color, texture);
+    const Float8 ramp = Float8::ramp();
+    Float8 edgeStep[3];
+    for(int i = 0; i < 3; ++i)
+        edgeStep[i] = ramp * setup.edgeA[i];
+    const Float8 zStep = ramp * setup.z.dx;
+    const Float8 ndotlStep = ramp * setup.ndotl.dx;
+    const Float8 inverseWStep = ramp * setup.inverseW.dx;
+    const Float8 uStep = ramp * setup.uOverW.dx;
+    const Float8 vStep = ramp * setup.vOverW.dx;
+
+    alignas(32) float depth[8];
+    alignas(32) float ndotl[8];
+    alignas(32) float us[8];
+    alignas(32) float vs[8];
+    float lods[8];
+    Color texels[8];
+    Uint8 factors[8];
+
+    // Walk 8x8 blocks, rejecting the ones which lie completely outside an edge
+    // or behind everything already drawn in them
+    for(int blockY = minY & ~7; blockY <= maxY; blockY += 8) {
+        for(int blockX = minX & ~7; blockX <= maxX; blockX += 8) {
+            bool outside = false;
+            for(int i = 0; i < 3 && !outside; ++i) {
+                float cornerX = blockX + (setup.edgeA[i] > 0.0f ? 7.5f : 0.5f);
+                float cornerY = blockY + (setup.edgeB[i] > 0.0f ? 7.5f : 0.5f);
+                outside = setup.edgeA[i] * cornerX + setup.edgeB[i] * cornerY + setup.edgeC[i] < setup.threshold[i];
             }
-        }
-    } else {
-        for(int y = v1.y; y <= v3.y; ++y) {
-            data.currentY = y;
-            if(y < v2.y) {
-                data.ndotla = nl1;
-                data.ndotlb = nl2;
-                data.ndotlc = nl1;
-                data.ndotld = nl3;
-                data.ua = vv1.textureCoordinates.x;
-                data.va = vv1.textureCoordinates.y;
-                data.ub = vv2.textureCoordinates.x;
-                data.vb = vv2.textureCoordinates.y;
-                data.uc = vv1.textureCoordinates.x;
-                data.vc = vv1.textureCoordinates.y;
-                data.ud = vv3.textureCoordinates.x;
-                data.vd = vv3.textureCoordinates.y;
-                this->proccessScanLine(data, vv1, vv2, vv1, vv3, color, texture);
-            } else {
-                data.ndotla = nl2;
-                data.ndotlb = nl3;
-                data.ndotlc = nl1;
-                data.ndotld = nl3;
-                data.ua = vv2.textureCoordinates.x;
-                data.va = vv2.textureCoordinates.y;
-                data.ub = vv3.textureCoordinates.x;
-                data.vb = vv3.textureCoordinates.y;
-                data.uc = vv1.textureCoordinates.x;
-                data.vc = vv1.textureCoordinates.y;
-                data.ud = vv3.textureCoordinates.x;
-                data.vd = vv3.textureCoordinates.y;
-                this->proccessScanLine(data, vv2, vv3, vv1, vv3, color, texture);
+            if(outside)
+                continue;
+
+            float nearest = setup.z.at(blockX + (setup.z.dx > 0.0f ? 0.5f : 7.5f), blockY + (setup.z.dy > 0.0f ? 0.5f : 7.5f));
+            if(std::max(nearest, setup.minZ) > m_blockDepth[blockX / BLOCK_SIZE + (blockY / BLOCK_SIZE) * m_blocksX])
+                continue;
+            bool written = false;
+
+            int columnMask = blockX + 8 > clip.maxX ? (1 << (clip.maxX - blockX)) - 1 : 0xff;
+            int rowStart = std::max(blockY, minY);
+            int rowEnd = std::min(blockY + 7, maxY);
+
+            for(int y = rowStart; y <= rowEnd; ++y) {
+                float px = blockX + 0.5f;
+                float py = y + 0.5f;
+                Float8 e0 = Float8(setup.edgeA[0] * px + setup.edgeB[0] * py + setup.edgeC[0]) + edgeStep[0];
+                Float8 e1 = Float8(setup.edgeA[1] * px + setup.edgeB[1] * py + setup.edgeC[1]) + edgeStep[1];
+                Float8 e2 = Float8(setup.edgeA[2] * px + setup.edgeB[2] * py + setup.edgeC[2]) + edgeStep[2];
+
+                int mask = movemask((e0 > Float8(setup.threshold[0])) & (e1 > Float8(setup.threshold[1])) & (e2 > Float8(setup.threshold[2]))) & columnMask;
+                if(!mask)
+                    continue;
+
+                Float8 z = Float8(setup.z.at(px, py)) + zStep;
+
+                // The eight pixels of a block row are contiguous in both layouts
+                int index = this->pixelIndex(blockX, y);
+                Float8 storedDepth;
+                if(blockX + 8 <= m_width) {
+                    storedDepth = Float8::load(m_depthBuffer + index);
+                } else {
+                    for(int i = 0; i < 8; ++i)
+                        depth[i] = (columnMask >> i) & 1 ? m_depthBuffer[index + i] : 0.0f;
+                    storedDepth = Float8::load(depth);
+                }
+                if(output == PixelOutput::EqualDepth)
+                    mask &= movemask(z == storedDepth);
+                else
+                    mask &= movemask(z <= storedDepth);
+                if(!mask)
+                    continue;
+                written = output != PixelOutput::EqualDepth;
+
+                if(output == PixelOutput::Visibility || output == PixelOutput::DepthOnly) {
+                    z.store(depth);
+                    for(int i = 0; i < 8; ++i) {
+                        if(!((mask >> i) & 1))
+                            continue;
+                        m_depthBuffer[index + i] = depth[i];
+                        if(output == PixelOutput::Visibility)
+                            m_visibilityBuffer[index + i] = id;
+                    }
+                    continue;
+                }
+
+                Float8 w = Float8(1.0f) / (Float8(setup.inverseW.at(px, py)) + inverseWStep);
+                z.store(depth);
+                (Float8(setup.ndotl.at(px, py)) + ndotlStep).store(ndotl);
+                ((Float8(setup.uOverW.at(px, py)) + uStep) * w).store(us);
+                ((Float8(setup.vOverW.at(px, py)) + vStep) * w).store(vs);
+
+                // One level of detail per 2x2 quad, the block starts on an even column
+                for(int i = 0; i < 8; i += 2)
+                    lods[i] = lods[i + 1] = (mask >> i) & 3 ? quadLod(setup, texture, blockX + i + 0.5f, (y & ~1) + 0.5f) : 0.0f;
+
+                texture.sample(us, vs, lods, mask, texels);
+                for(int i = 0; i < 8; ++i)
+                    factors[i] = lightFactor(ndotl[i]);
+                scale(texels, texels, factors, 8);
+                modulate(texels, texels, color, 8);
+
+                for(int i = 0; i < 8; ++i) {
+                    if(!((mask >> i) & 1))
+                        continue;
+                    if(output != PixelOutput::EqualDepth)
+                        m_depthBuffer[index + i] = depth[i];
+                    m_back_buffer[index + i] = texels[i];
+                }
             }
+
+            if(written)
+                this->updateBlockDepth(blockX / BLOCK_SIZE, blockY / BLOCK_SIZE);
         }
     }
 }
 
-Vertex Device::project(Vertex& vertex, glm::mat4& MVP, glm::mat4& modelMatrix)
+// The viewport maps [-0.5, 0.5] of the normalized device coordinates onto the screen
+static const float VIEWPORT_EXTENT = 0.5f;
+// Triangles are clipped in x and y only when they leave this larger area, the
+// part between it and the viewport is discarded by the rasterizers' clip rectangles
+static const float GUARD_BAND_EXTENT = 4.0f;
+static const int CLIP_PLANES_COUNT = 6;
+// A triangle clipped by all six planes has at most nine vertices
+static const int MAX_CLIPPED_VERTICES = 9;
+
+static const glm::vec3 LIGHT_POSITION(0, 10, -10);
+
+static float clipDistance(const glm::vec4& position, int plane, float extent)
 {
-    auto point = MVP * glm::vec4(vertex.coordinates, 1.0f);
-    point /= point.w;
+    switch(plane) {
+    case 0: return position.z;
+    case 1: return position.w - position.z;
+    case 2: return position.x + extent * position.w;
+    case 3: return extent * position.w - position.x;
+    case 4: return position.y + extent * position.w;
+    default: return extent * position.w - position.y;
+    }
+}
 
-    auto worldPoint = modelMatrix * glm::vec4(vertex.coordinates, 1.0f);
-    worldPoint /= worldPoint.w;
-    auto worldNormal = modelMatrix * glm::vec4(vertex.normal, 1.0f);
-    worldNormal /= worldNormal.w;
+// Computes the bits of the planes, in clipDistance order, which each of the eight vertices is outside of
+static void outCodes(const Float8& x, const Float8& y, const Float8& z, const Float8& w, float extent, Uint8 *codes)
+{
+    const Float8 zero(0.0f);
+    const Float8 limit = w * extent;
+    int outside[CLIP_PLANES_COUNT] = {
+        movemask(z < zero),
+        movemask(w - z < zero),
+        movemask(x + limit < zero),
+        movemask(limit - x < zero),
+        movemask(y + limit < zero),
+        movemask(limit - y < zero)
+    };
 
-    float x = point.x * m_width + m_width / 2.0f;
-    float y = -point.y * m_height + m_height / 2.0f;
-    Vertex result;
-    result.coordinates = glm::vec3(x, y, point.z);
-    result.normal = glm::vec3(worldNormal);
-    result.worldCoordinates = glm::vec3(worldPoint);
-    result.textureCoordinates = vertex.textureCoordinates;
+    for(int lane = 0; lane < 8; ++lane) {
+        int code = 0;
+        for(int plane = 0; plane < CLIP_PLANES_COUNT; ++plane)
+            code |= ((outside[plane] >> lane) & 1) << plane;
+        codes[lane] = code;
+    }
+}
+
+void TransformedVertices::resize(int count)
+{
+    // Padded so the vertex pass can always store eight lanes
+    int padded = (count + 7) & ~7;
+    for(std::vector<float>* array : {&clipX, &clipY, &clipZ, &clipW, &screenX, &screenY, &screenZ, &inverseW,
+                                     &ndotl, &u, &v})
+        array->resize(padded);
+    viewportCodes.resize(padded);
+    guardBandCodes.resize(padded);
+}
+
+ClipVertex TransformedVertices::clipVertex(int index) const
+{
+    ClipVertex result;
+    result.position = glm::vec4(clipX[index], clipY[index], clipZ[index], clipW[index]);
+    result.ndotl = ndotl[index];
+    result.textureCoordinates = glm::vec2(u[index], v[index]);
     return result;
 }
 
-//#define PARALLEL
+ScreenVertex TransformedVertices::screenVertex(int index) const
+{
+    ScreenVertex result;
+    result.position = glm::vec3(screenX[index], screenY[index], screenZ[index]);
+    result.inverseW = inverseW[index];
+    result.ndotl = ndotl[index];
+    result.textureCoordinates = glm::vec2(u[index], v[index]);
+    return result;
+}
 
-void Device::render(const Camera &camera, std::vector<Mesh> &meshes)
+void Device::transformVertices(Mesh& mesh, const glm::mat4& MVP, const glm::mat4& modelMatrix)
 {
-    auto viewMatrix = lookAtLH(camera.position(), camera.target(), glm::vec3(0.0f, 1.0f, 0.0f));
-    auto projectionMatrix = perspectiveFovLH(0.78f, static_cast<float>(m_width) / m_height, 0.01f, 1.0f);
-
-#ifdef PARALLEL
-    struct vector {
-        int index;
-        std::vector<Vertex> m_backingVector;
-
-        vector(int size)
-            :index(0), m_backingVector(size)
-        {}
-
-        void push_back(Vertex& point)
-        {
-            if(m_backingVector.size() == index)
-                m_backingVector.resize(index * 2);
-            m_backingVector[index++] = point;
+    const std::vector<Vertex>& vertices = mesh.vertices();
+    const int count = vertices.size();
+    TransformedVertices& out = m_vertices;
+    out.resize(count);
+
+    const float width = m_width;
+    const float height = m_height;
+    const glm::mat4& m = modelMatrix;
+
+#pragma omp parallel for
+    for(int first = 0; first < count; first += 8) {
+        // Gather eight vertices, repeating the last one past the end of the mesh
+        alignas(32) float px[8], py[8], pz[8], nx[8], ny[8], nz[8], tu[8], tv[8];
+        for(int lane = 0; lane < 8; ++lane) {
+            const Vertex& vertex = vertices[std::min(first + lane, count - 1)];
+            px[lane] = vertex.coordinates.x;
+            py[lane] = vertex.coordinates.y;
+            pz[lane] = vertex.coordinates.z;
+            nx[lane] = vertex.normal.x;
+            ny[lane] = vertex.normal.y;
+            nz[lane] = vertex.normal.z;
+            tu[lane] = vertex.textureCoordinates.x;
+            tv[lane] = vertex.textureCoordinates.y;
         }
-    };
+        Float8 x = Float8::load(px), y = Float8::load(py), z = Float8::load(pz);
+        Float8 normalX = Float8::load(nx), normalY = Float8::load(ny), normalZ = Float8::load(nz);
+
+        Float8 clipX = x * MVP[0][0] + y * MVP[1][0] + z * MVP[2][0] + MVP[3][0];
+        Float8 clipY = x * MVP[0][1] + y * MVP[1][1] + z * MVP[2][1] + MVP[3][1];
+        Float8 clipZ = x * MVP[0][2] + y * MVP[1][2] + z * MVP[2][2] + MVP[3][2];
+        Float8 clipW = x * MVP[0][3] + y * MVP[1][3] + z * MVP[2][3] + MVP[3][3];
+
+        // The model matrix is affine, so there is no w to divide by
+        Float8 worldX = x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0];
+        Float8 worldY = x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1];
+        Float8 worldZ = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+        // Normals are directions, so they are not translated
+        Float8 worldNormalX = normalX * m[0][0] + normalY * m[1][0] + normalZ * m[2][0];
+        Float8 worldNormalY = normalX * m[0][1] + normalY * m[1][1] + normalZ * m[2][1];
+        Float8 worldNormalZ = normalX * m[0][2] + normalY * m[1][2] + normalZ * m[2][2];
+
+        Float8 lightX = Float8(LIGHT_POSITION.x) - worldX;
+        Float8 lightY = Float8(LIGHT_POSITION.y) - worldY;
+        Float8 lightZ = Float8(LIGHT_POSITION.z) - worldZ;
+        Float8 dot = worldNormalX * lightX + worldNormalY * lightY + worldNormalZ * lightZ;
+        Float8 lengths = sqrt((worldNormalX * worldNormalX + worldNormalY * worldNormalY + worldNormalZ * worldNormalZ) *
+                              (lightX * lightX + lightY * lightY + lightZ * lightZ));
+        Float8 ndotl = max(dot / lengths, Float8(0.0f));
+
+        // Only meaningful for the vertices in front of the near plane, the rest are always clipped
+        Float8 inverseW = Float8(1.0f) / clipW;
+        Float8 screenX = clipX * inverseW * width + width / 2.0f;
+        Float8 screenY = Float8(height / 2.0f) - clipY * inverseW * height;
+        Float8 screenZ = clipZ * inverseW;
+
+        clipX.store(&out.clipX[first]);
+        clipY.store(&out.clipY[first]);
+        clipZ.store(&out.clipZ[first]);
+        clipW.store(&out.clipW[first]);
+        screenX.store(&out.screenX[first]);
+        screenY.store(&out.screenY[first]);
+        screenZ.store(&out.screenZ[first]);
+        inverseW.store(&out.inverseW[first]);
+        ndotl.store(&out.ndotl[first]);
+        Float8::load(tu).store(&out.u[first]);
+        Float8::load(tv).store(&out.v[first]);
+        outCodes(clipX, clipY, clipZ, clipW, VIEWPORT_EXTENT, &out.viewportCodes[first]);
+        outCodes(clipX, clipY, clipZ, clipW, GUARD_BAND_EXTENT, &out.guardBandCodes[first]);
+    }
+}
 
-    vector quadrant1(500);
-    vector quadrant2(500);
-    vector quadrant3(500);
-    vector quadrant4(500);
-    vector quadrantCommon(500);
+ScreenVertex Device::project(const ClipVertex& vertex)
+{
+    float inverseW = 1.0f / vertex.position.w;
+    auto point = vertex.position * inverseW;
 
-    int halfWidth = m_width / 2;
-    int halfHeight = m_height / 2;
-#endif
+    float x = point.x * m_width + m_width / 2.0f;
+    float y = -point.y * m_height + m_height / 2.0f;
+    ScreenVertex result;
+    result.position = glm::vec3(x, y, point.z);
+    result.inverseW = inverseW;
+    result.ndotl = vertex.ndotl;
+    result.textureCoordinates = vertex.textureCoordinates;
+    return result;
+}
 
-    for(Mesh& mesh : meshes) {
-        auto modelMatrix = glm::translate(glm::mat4(1.0f), mesh.position()) *
-                glm::yawPitchRoll(mesh.rotation().y, mesh.rotation().x, mesh.rotation().z);
+static ClipVertex interpolate(const ClipVertex& a, const ClipVertex& b, float t)
+{
+    ClipVertex result;
+    result.position = glm::mix(a.position, b.position, t);
+    result.ndotl = glm::mix(a.ndotl, b.ndotl, t);
+    result.textureCoordinates = glm::mix(a.textureCoordinates, b.textureCoordinates, t);
+    return result;
+}
 
-        auto MVP = projectionMatrix * viewMatrix * modelMatrix;
+void Device::clipTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int clipMask, const Texture& texture)
+{
+    // Sutherland-Hodgman against every plane that the triangle crosses
+    ClipVertex buffers[2][MAX_CLIPPED_VERTICES];
+    ClipVertex *input = buffers[0];
+    ClipVertex *output = buffers[1];
+    input[0] = a;
+    input[1] = b;
+    input[2] = c;
+    int count = 3;
+
+    for(int plane = 0; plane < CLIP_PLANES_COUNT && count >= 3; ++plane) {
+        if(!(clipMask & (1 << plane)))
+            continue;
+
+        int outputCount = 0;
+        for(int i = 0; i < count; ++i) {
+            const ClipVertex& current = input[i];
+            const ClipVertex& next = input[(i + 1) % count];
+            float currentDistance = clipDistance(current.position, plane, GUARD_BAND_EXTENT);
+            float nextDistance = clipDistance(next.position, plane, GUARD_BAND_EXTENT);
+
+            if(currentDistance >= 0.0f)
+                output[outputCount++] = current;
+            if((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                output[outputCount++] = interpolate(current, next, currentDistance / (currentDistance - nextDistance));
+        }
+        std::swap(input, output);
+        count = outputCount;
+    }
 
-        for(Face& face : mesh.faces()) {
+    if(count < 3)
+        return;
 
-            auto transformedNormal = modelMatrix * glm::vec4(face.normal, 0.0f);
-            auto worldCoordinate = modelMatrix * glm::vec4(((mesh.vertices()[face.A].coordinates + mesh.vertices()[face.B].coordinates + mesh.vertices()[face.C].coordinates) / 3.0f), 1.0f);
-            auto cameraVector = camera.position() - glm::vec3(worldCoordinate);
+    ScreenVertex projected[MAX_CLIPPED_VERTICES];
+    for(int i = 0; i < count; ++i)
+        projected[i] = this->project(input[i]);
+    for(int i = 1; i + 1 < count; ++i)
+        this->emitTriangle(projected[0], projected[i], projected[i + 1], texture);
+}
 
-            auto cosAngle = glm::normalizeDot(cameraVector, glm::vec3(transformedNormal));
-            if(cosAngle < 0)
-                continue;
+void Device::emitTriangle(const ScreenVertex& v1, const ScreenVertex& v2, const ScreenVertex& v3, const Texture& texture)
+{
+    BinnedTriangle triangle;
+    if(!setupTriangle(v1, v2, v3, triangle.setup)) {
+        ++m_statistics.degenerate;
+        return;
+    }
+    triangle.texture = &texture;
+    m_triangles.push_back(triangle);
+}
 
-            auto pointA = this->project(mesh.vertices()[face.A], MVP, modelMatrix);
-            auto pointB = this->project(mesh.vertices()[face.B], MVP, modelMatrix);
-            auto pointC = this->project(mesh.vertices()[face.C], MVP, modelMatrix);
-#ifdef PARALLEL
-            int result = 0;
-            result += pointA.coordinates.x >= halfWidth ? 1 : 0;
-            result += pointB.coordinates.x >= halfWidth ? 1 : 0;
-            result += pointC.coordinates.x >= halfWidth ? 1 : 0;
-            result += pointA.coordinates.y >= halfHeight ? 4 : 0;
-            result += pointB.coordinates.y >= halfHeight ? 4 : 0;
-            result += pointC.coordinates.y >= halfHeight ? 4 : 0;
-
-            vector *p_quadrant = &quadrantCommon;
-            switch(result) {
-            case 0:  p_quadrant = &quadrant2; break;
-            case 3:  p_quadrant = &quadrant1; break;
-            case 12: p_quadrant = &quadrant3; break;
-            case 15: p_quadrant = &quadrant4; break;
+void Device::setupTriangles(Mesh& mesh)
+{
+    const TransformedVertices& vertices = m_vertices;
+    const std::vector<Face>& faces = mesh.faces();
+    const int count = faces.size();
+    const Texture& texture = mesh.texture();
+    // Only the half-space rasterizer samples at pixel centers
+    const bool cullSubPixel = m_rasterizer == RasterizerType::HalfSpace;
+
+    m_statistics.triangles += count;
+
+    for(int first = 0; first < count; first += 8) {
+        alignas(32) float screenX[3][8], screenY[3][8], clipX[3][8], clipY[3][8], clipW[3][8];
+        int offScreenMask = 0;
+        int clipMasks[8];
+        int indices[8][3];
+
+        // Gather eight faces, repeating the last one past the end of the mesh
+        for(int lane = 0; lane < 8; ++lane) {
+            const Face& face = faces[std::min(first + lane, count - 1)];
+            indices[lane][0] = face.A;
+            indices[lane][1] = face.B;
+            indices[lane][2] = face.C;
+            for(int corner = 0; corner < 3; ++corner) {
+                int index = indices[lane][corner];
+                screenX[corner][lane] = vertices.screenX[index];
+                screenY[corner][lane] = vertices.screenY[index];
+                clipX[corner][lane] = vertices.clipX[index];
+                clipY[corner][lane] = vertices.clipY[index];
+                clipW[corner][lane] = vertices.clipW[index];
             }
-
-            p_quadrant->push_back(pointA);
-            p_quadrant->push_back(pointB);
-            p_quadrant->push_back(pointC);
-#else
-            this->drawTriangle(pointA, pointB, pointC, Color(255, 255, 255, 255), mesh.texture());
-#endif
-
+            if(vertices.viewportCodes[face.A] & vertices.viewportCodes[face.B] & vertices.viewportCodes[face.C])
+                offScreenMask |= 1 << lane;
+            clipMasks[lane] = vertices.guardBandCodes[face.A] | vertices.guardBandCodes[face.B] | vertices.guardBandCodes[face.C];
         }
-#ifdef PARALLEL
-//std::cerr << quadrant1.size() << "  " << quadrant2.size() << " " << quadrant3.size() << " " << quadrant4.size() << " " << quadrantCommon.size() << std::endl;
 
-            auto drawTask = [](Device* dev, vector &arr, Mesh& mesh)
-            {
-                for(auto i = 0; i < arr.index; i += 3) {
-                    dev->drawTriangle(arr.m_backingVector[i], arr.m_backingVector[i + 1], arr.m_backingVector[i + 2], Color(255, 255, 255, 255), mesh.texture());
-                }
-            };
-
-#pragma omp parallel sections
-        {
-         #pragma omp section
-            {
-    //            std::cout << omp_get_num_thread();
-                drawTask(this, quadrant1, mesh);
+        // Orientation from the homogeneous 2D determinant, which stays valid
+        // for triangles with vertices behind the eye
+        Float8 x0 = Float8::load(clipX[0]), x1 = Float8::load(clipX[1]), x2 = Float8::load(clipX[2]);
+        Float8 y0 = Float8::load(clipY[0]), y1 = Float8::load(clipY[1]), y2 = Float8::load(clipY[2]);
+        Float8 w0 = Float8::load(clipW[0]), w1 = Float8::load(clipW[1]), w2 = Float8::load(clipW[2]);
+        Float8 determinant = x0 * (y1 * w2 - y2 * w1) - y0 * (x1 * w2 - x2 * w1) + w0 * (x1 * y2 - x2 * y1);
+        int degenerateMask = movemask(determinant == Float8(0.0f));
+        int backFacingMask = movemask(determinant < Float8(0.0f));
+
+        // Triangles whose bounding box does not contain a single pixel center
+        Float8 sx0 = Float8::load(screenX[0]), sx1 = Float8::load(screenX[1]), sx2 = Float8::load(screenX[2]);
+        Float8 sy0 = Float8::load(screenY[0]), sy1 = Float8::load(screenY[1]), sy2 = Float8::load(screenY[2]);
+        Float8 minX = min(sx0, min(sx1, sx2)) - 0.5f;
+        Float8 minY = min(sy0, min(sy1, sy2)) - 0.5f;
+        Float8 maxX = max(sx0, max(sx1, sx2)) - 0.5f;
+        Float8 maxY = max(sy0, max(sy1, sy2)) - 0.5f;
+        int subPixelMask = cullSubPixel ? movemask((floor(maxX) < minX) | (floor(maxY) < minY)) : 0;
+
+        int lanes = std::min(8, count - first);
+        for(int lane = 0; lane < lanes; ++lane) {
+            int bit = 1 << lane;
+            const int *face = indices[lane];
+            if(offScreenMask & bit) {
+                ++m_statistics.offScreen;
+            } else if(degenerateMask & bit) {
+                ++m_statistics.degenerate;
+            } else if(backFacingMask & bit) {
+                ++m_statistics.backFacing;
+            } else if(clipMasks[lane]) {
+                // Screen positions are not usable here, the clipper emits what is left
+                ++m_statistics.clipped;
+                this->clipTriangle(vertices.clipVertex(face[0]), vertices.clipVertex(face[1]), vertices.clipVertex(face[2]), clipMasks[lane], texture);
+            } else if(subPixelMask & bit) {
+                ++m_statistics.subPixel;
+            } else {
+                this->emitTriangle(vertices.screenVertex(face[0]), vertices.screenVertex(face[1]), vertices.screenVertex(face[2]), texture);
             }
-        #pragma omp section
-           {
-            drawTask(this, quadrant2, mesh);
-           }
-        #pragma omp section
-           {
-            drawTask(this, quadrant3, mesh);
-           }
-        #pragma omp section
-           {
-            drawTask(this, quadrant4, mesh);
-           }
         }
+    }
+}
 
-        drawTask(this, quadrantCommon, mesh);
-#endif
+void Device::binTriangles()
+{
+    for(auto& bin : m_tileBins)
+        bin.clear();
+
+    const int count = m_triangles.size();
+    for(int index = 0; index < count; ++index) {
+        const TriangleSetup& setup = m_triangles[index].setup;
+        if(setup.maxX < 0 || setup.maxY < 0 || setup.minX >= m_width || setup.minY >= m_height)
+            continue;
+
+        int tileMinX = std::max(setup.minX, 0) / TILE_SIZE;
+        int tileMinY = std::max(setup.minY, 0) / TILE_SIZE;
+        int tileMaxX = std::min(setup.maxX, m_width - 1) / TILE_SIZE;
+        int tileMaxY = std::min(setup.maxY, m_height - 1) / TILE_SIZE;
+
+        for(int tileY = tileMinY; tileY <= tileMaxY; ++tileY) {
+            for(int tileX = tileMinX; tileX <= tileMaxX; ++tileX) {
+                m_tileBins[tileX + tileY * m_tilesX].push_back(index);
+            }
+        }
     }
 }
 
-class Material
+// Planes of the view volume in world space, in clipDistance order. A point p
+// is inside a plane when dot(plane, (p, 1)) is positive.
+static void extractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[CLIP_PLANES_COUNT])
 {
-public:
-    std::string name;
-    std::string id;
-    std::string diffuseTextureName;
-};
+    const glm::mat4& m = viewProjection;
+    glm::vec4 rowX(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 rowY(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 rowZ(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 rowW(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = rowZ;
+    planes[1] = rowW - rowZ;
+    planes[2] = rowX + rowW * VIEWPORT_EXTENT;
+    planes[3] = rowW * VIEWPORT_EXTENT - rowX;
+    planes[4] = rowY + rowW * VIEWPORT_EXTENT;
+    planes[5] = rowW * VIEWPORT_EXTENT - rowY;
+
+    for(int i = 0; i < CLIP_PLANES_COUNT; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
 
-void Device::loadJSONFile(std::string filename, std::vector<Mesh> &meshesVector)
+static bool isInsideFrustum(const Mesh& mesh, const glm::mat4& modelMatrix, const glm::vec4 planes[CLIP_PLANES_COUNT])
 {
-    std::ifstream file(filename);
-    std::string content;
-    content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-    json::Value data = json::Deserialize(content);
-    json::Object obj = data.ToObject();
-    json::Array meshes = obj["meshes"];
-    std::unordered_map<std::string, Material> materials;
-    json::Array mats = obj["materials"];
-    for(auto& material : mats) {
-        Material mat;
-        mat.name = material["name"].ToString();
-        mat.id = material["id"].ToString();
-        mat.diffuseTextureName = material["diffuseTexture"]["name"].ToString();
-
-        materials.insert(std::make_pair(mat.id, mat));
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundingCenter(), 1.0f));
+    glm::vec3 extents = (mesh.boundsMax() - mesh.boundsMin()) * 0.5f;
+    glm::vec3 axisX = glm::vec3(modelMatrix[0]);
+    glm::vec3 axisY = glm::vec3(modelMatrix[1]);
+    glm::vec3 axisZ = glm::vec3(modelMatrix[2]);
+
+    for(int i = 0; i < CLIP_PLANES_COUNT; ++i) {
+        glm::vec3 normal = glm::vec3(planes[i]);
+        float distance = glm::dot(normal, center) + planes[i].w;
+        if(distance < -mesh.boundingRadius())
+            return false;
+
+        // The box is rotated with the mesh, so project its half extents on the plane normal
+        float radius = extents.x * std::abs(glm::dot(normal, axisX))
+                + extents.y * std::abs(glm::dot(normal, axisY))
+                + extents.z * std::abs(glm::dot(normal, axisZ));
+        if(distance < -radius)
+            return false;
     }
+    return true;
+}
+
+void Device::render(const Camera &camera, std::vector<Mesh> &meshes)
+{
+    auto viewMatrix = lookAtLH(camera.position(), camera.target(), glm::vec3(0.0f, 1.0f, 0.0f));
+    auto projectionMatrix = perspectiveFovLH(0.78f, static_cast<float>(m_width) / m_height, 0.01f, 100.0f);
+
+    auto viewProjection = projectionMatrix * viewMatrix;
+
+    glm::vec4 frustumPlanes[CLIP_PLANES_COUNT];
+    extractFrustumPlanes(viewProjection, frustumPlanes);
 
-    for(auto& mesh : meshes) {
-        auto verticesArray = mesh["vertices"];
-        auto indicesArray = mesh["indices"];
-        auto uvCount = mesh["uvCount"].ToInt();
-        int verticesStep = 1;
+    // Nothing samples the textures between frames, so the decoded images can take the placeholders' place
+    m_textureCache.update();
 
-        switch(uvCount) {
-        case 0: verticesStep = 6; break;
-        case 1: verticesStep = 8; break;
-        case 2: verticesStep = 10; break;
+    m_triangles.clear();
+    m_statistics = FrameStatistics();
+    m_statistics.meshes = meshes.size();
+
+    // Visible meshes are drawn front to back, so the nearest surfaces reach the
+    // depth buffer first and hide as much as possible of what comes after them
+    m_drawOrder.clear();
+    for(size_t i = 0; i < meshes.size(); ++i) {
+        Mesh& mesh = meshes[i];
+        auto modelMatrix = glm::translate(glm::mat4(1.0f), mesh.position()) *
+                glm::yawPitchRoll(mesh.rotation().y, mesh.rotation().x, mesh.rotation().z);
+
+        if(!isInsideFrustum(mesh, modelMatrix, frustumPlanes)) {
+            ++m_statistics.culledMeshes;
+            continue;
         }
-        int verticesCount = verticesArray.size() / verticesStep;
-        int facesCount = indicesArray.size() / 3;
-        meshesVector.push_back(Mesh(mesh["name"].ToString(), verticesCount, facesCount));
-        Mesh& currentMesh = meshesVector.back();
-        for(int i = 0; i < verticesCount; ++i) {
-            float x = verticesArray[i * verticesStep].ToFloat();
-            float y = verticesArray[i * verticesStep + 1].ToFloat();
-            float z = verticesArray[i * verticesStep + 2].ToFloat();
-            //Normals
-            float nx = verticesArray[i * verticesStep + 3].ToFloat();
-            float ny = verticesArray[i * verticesStep + 4].ToFloat();
-            float nz = verticesArray[i * verticesStep + 5].ToFloat();
-            currentMesh.vertices()[i].coordinates = glm::vec3(x, y, z);
-            currentMesh.vertices()[i].normal = glm::vec3(nx, ny, nz);
-            if(uvCount > 0) {
-                float u = verticesArray[i * verticesStep + 6].ToFloat();
-                float v = verticesArray[i * verticesStep + 7].ToFloat();
-                currentMesh.vertices()[i].textureCoordinates = glm::vec2(u, v);
-            }
+
+        glm::vec3 center(modelMatrix * glm::vec4(mesh.boundingCenter(), 1.0f));
+        m_drawOrder.push_back({glm::length(center - camera.position()), static_cast<int>(i), modelMatrix});
+    }
+    std::stable_sort(m_drawOrder.begin(), m_drawOrder.end(), [](const MeshDraw& a, const MeshDraw& b) {
+        return a.distance < b.distance;
+    });
+
+    // Geometry pass : transform the vertices, cull, clip and set up the visible faces
+    for(const MeshDraw& draw : m_drawOrder) {
+        Mesh& mesh = meshes[draw.mesh];
+        const glm::mat4& modelMatrix = draw.modelMatrix;
+        auto MVP = viewProjection * modelMatrix;
+
+        this->transformVertices(mesh, MVP, modelMatrix);
+        this->setupTriangles(mesh);
+    }
+    m_statistics.rasterized = m_triangles.size();
+
+    this->binTriangles();
+
+    // Raster pass : every tile owns its own pixels, so tiles can be drawn concurrently
+    const int tilesCount = m_tilesX * m_tilesY;
+    int occluded = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:occluded)
+    for(int tile = 0; tile < tilesCount; ++tile) {
+        occluded += this->drawTile(tile);
+    }
+    m_statistics.occluded = occluded;
+}
+
+template<PixelOutput output>
+void Device::rasterize(const BinnedTriangle& triangle, Uint32 id, const ClipRect& clip)
+{
+    if(m_rasterizer == RasterizerType::HalfSpace)
+        this->drawTriangleHalfSpace<output>(triangle.setup, Color(255, 255, 255, 255), *triangle.texture, clip, id);
+    else
+        this->drawTriangle<output>(triangle.setup, Color(255, 255, 255, 255), *triangle.texture, clip, id);
+}
+
+int Device::drawTile(int tile)
+{
+    const std::vector<int>& bin = m_tileBins[tile];
+    if(bin.empty())
+        return 0;
+
+    ClipRect clip = this->tileRect(tile);
+    this->initializeTile(tile);
+    int occluded = 0;
+
+    switch(m_renderMode) {
+    case RenderMode::Forward:
+        for(int index : bin) {
+            if(this->isOccluded(m_triangles[index].setup, clip))
+                ++occluded;
+            else
+                this->rasterize<PixelOutput::Shaded>(m_triangles[index], index, clip);
+        }
+        break;
+    case RenderMode::VisibilityBuffer:
+        for(int y = clip.minY; y < clip.maxY; ++y)
+            for(int x = clip.minX; x < clip.maxX; ++x)
+                m_visibilityBuffer[this->pixelIndex(x, y)] = NO_TRIANGLE;
+        for(int index : bin) {
+            if(this->isOccluded(m_triangles[index].setup, clip))
+                ++occluded;
+            else
+                this->rasterize<PixelOutput::Visibility>(m_triangles[index], index, clip);
+        }
+        this->shadeVisibility(clip);
+        break;
+    case RenderMode::DepthPrePass:
+        for(int index : bin) {
+            if(!this->isOccluded(m_triangles[index].setup, clip))
+                this->rasterize<PixelOutput::DepthOnly>(m_triangles[index], index, clip);
         }
+        // The depth buffer now holds the final surface, only the triangles owning it get shaded
+        for(int index : bin) {
+            if(this->isOccluded(m_triangles[index].setup, clip))
+                ++occluded;
+            else
+                this->rasterize<PixelOutput::EqualDepth>(m_triangles[index], index, clip);
+        }
+        break;
+    }
 
-        for(int i = 0; i < facesCount; ++i) {
-            int a = indicesArray[i * 3].ToInt();
-            int b = indicesArray[i * 3 + 1].ToInt();
-            int c = indicesArray[i * 3 + 2].ToInt();
-            currentMesh.faces()[i] = {a, b, c};
+    return occluded;
+}
+
+void Device::shadeVisibility(const ClipRect& clip)
+{
+    // Attributes are evaluated where the rasterizer sampled coverage and depth :
+    // pixel centers for the half-space one, integer positions for the scanline one
+    const float offset = m_rasterizer == RasterizerType::HalfSpace ? 0.5f : 0.0f;
+    const Color color(255, 255, 255, 255);
+
+    for(int y = clip.minY; y < clip.maxY; ++y) {
+        for(int x = clip.minX; x < clip.maxX; ++x) {
+            int index = this->pixelIndex(x, y);
+            Uint32 id = m_visibilityBuffer[index];
+            if(id == NO_TRIANGLE)
+                continue;
+
+            const BinnedTriangle& triangle = m_triangles[id];
+            const TriangleSetup& setup = triangle.setup;
+            float px = x + offset;
+            float py = y + offset;
+            float w = 1.0f / setup.inverseW.at(px, py);
+            float lod = quadLod(setup, *triangle.texture, (x & ~1) + offset, (y & ~1) + offset);
+            Color textureColor = triangle.texture->sample(setup.uOverW.at(px, py) * w, setup.vOverW.at(px, py) * w, lod);
+            m_back_buffer[index] = modulate(scale(textureColor, lightFactor(setup.ndotl.at(px, py))), color);
         }
+    }
+}
+
+void Device::optimizeMeshes(std::vector<Mesh>& meshes, size_t first)
+{
+    int count = meshes.size() - first;
+    int verticesBefore = 0;
+    int verticesAfter = 0;
+    int triangles = 0;
+    // Vertices transformed, from which the average cache miss ratios over all the meshes follow
+    double missesBefore = 0.0;
+    double missesAfter = 0.0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:verticesBefore, verticesAfter, triangles, missesBefore, missesAfter)
+    for(int i = 0; i < count; ++i) {
+        MeshOptimization optimization = optimizeMesh(meshes[first + i]);
+        verticesBefore += optimization.verticesBefore;
+        verticesAfter += optimization.verticesAfter;
+        triangles += optimization.triangles;
+        missesBefore += static_cast<double>(optimization.acmrBefore) * optimization.triangles;
+        missesAfter += static_cast<double>(optimization.acmrAfter) * optimization.triangles;
+    }
+
+    if(triangles > 0) {
+        std::cout << "Optimized " << count << " meshes, " << triangles << " triangles : "
+                  << verticesBefore << " -> " << verticesAfter << " vertices, ACMR "
+                  << missesBefore / triangles << " -> " << missesAfter / triangles << std::endl;
+    }
+}
+
+void Device::loadJSONFile(std::string filename, std::vector<Mesh> &meshesVector)
+{
+    size_t first = meshesVector.size();
+    loadBabylonFile(filename, meshesVector, m_textureCache);
+    if(m_optimizeMeshes)
+        this->optimizeMeshes(meshesVector, first);
+}
 
-        auto position = mesh["position"].ToArray();
-        currentMesh.setPosition(glm::vec3(position[0].ToFloat(), position[1].ToFloat(), position[2].ToFloat()));
-        if(uvCount > 0) {
-            std::string meshTextureId = mesh["materialId"].ToString();
-            std::string meshTextureName = materials[meshTextureId].diffuseTextureName;
-            currentMesh.setTexture(new Texture(meshTextureName, 512, 512));
+bool Device::loadSceneFile(std::string filename, std::vector<Mesh> &meshes)
+{
+    // A missing scene is not an error, the caller falls back to another format
+    if(!std::ifstream(filename))
+        return false;
+
+    SceneFile scene;
+    if(!scene.open(filename)) {
+        std::cerr << "Cannot load scene named " << filename << std::endl;
+        return false;
+    }
+
+    meshes.reserve(meshes.size() + scene.meshesCount());
+    for(int i = 0; i < scene.meshesCount(); ++i) {
+        const SceneFileMesh& record = scene.mesh(i);
+        meshes.push_back(Mesh(scene.string(record.name), record.verticesCount, record.facesCount));
+        Mesh& mesh = meshes.back();
+        if(record.material >= 0) {
+            std::string textureName = scene.string(scene.material(record.material).diffuseTextureName);
+            mesh.setTexture(m_textureCache.load(textureName));
+            mesh.setTextureName(textureName);
+        } else {
+            mesh.setTexture(m_textureCache.white());
         }
 
-        currentMesh.computeFaceNormal();
-    }            
+        // Face normals are stored with the faces
+        std::memcpy(mesh.vertices().data(), scene.vertices(record), record.verticesCount * sizeof(Vertex));
+        std::memcpy(mesh.faces().data(), scene.faces(record), record.facesCount * sizeof(Face));
+        mesh.setPosition(glm::vec3(record.position[0], record.position[1], record.position[2]));
+        mesh.computeBounds();
+    }
+
+    if(m_optimizeMeshes)
+        this->optimizeMeshes(meshes, meshes.size() - scene.meshesCount());
+    return true;
 }
 
 }//end of namespace
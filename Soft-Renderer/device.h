@@ -8,41 +8,245 @@
 #include "camera.h"
 #include "mesh.h"
 #include "color.h"
+#include "texturecache.h"
 
 namespace SoftEngine
 {
 
-namespace // annonymous namespace
+enum class RasterizerType
 {
-struct ScanLineData
+    ScanLine,
+    HalfSpace
+};
+
+enum class RenderMode
+{
+    // Shade every pixel which passes the depth test while rasterizing
+    Forward,
+    // Rasterize only depth and triangle ids, then shade each visible pixel once
+    VisibilityBuffer,
+    // Rasterize only depth, then shade the pixels whose depth matches exactly
+    DepthPrePass
+};
+
+enum class FramebufferLayout
+{
+    // Row after row
+    Linear,
+    // 8x8 blocks stored one after the other, each one row after row
+    Tiled
+};
+
+// What the rasterizers write for the pixels passing the depth test
+enum class PixelOutput
+{
+    Shaded,
+    Visibility,
+    DepthOnly,
+    // Shade when equal to the stored depth, without writing it
+    EqualDepth
+};
+
+// Vertex after the model view projection transform, before the perspective divide
+struct ClipVertex
+{
+    glm::vec4 position;
+    float ndotl;
+    glm::vec2 textureCoordinates;
+};
+
+// Vertex after the perspective divide, x and y are in pixels
+struct ScreenVertex
 {
-    int currentY;
-    float ndotla;
-    float ndotlb;
-    float ndotlc;
-    float ndotld;
-    float ua;
-    float ub;
-    float uc;
-    float ud;
-    float va;
-    float vb;
-    float vc;
-    float vd;
+    glm::vec3 position;
+    float inverseW;
+    float ndotl;
+    glm::vec2 textureCoordinates;
+};
+
+// Mesh vertices after the vertex pass, stored as structure of arrays so they
+// can be processed eight at a time. The arrays are padded to a multiple of eight.
+struct TransformedVertices
+{
+    std::vector<float> clipX;
+    std::vector<float> clipY;
+    std::vector<float> clipZ;
+    std::vector<float> clipW;
+    std::vector<float> screenX;
+    std::vector<float> screenY;
+    std::vector<float> screenZ;
+    std::vector<float> inverseW;
+    std::vector<float> ndotl;
+    std::vector<float> u;
+    std::vector<float> v;
+    // Clip planes each vertex is outside of, for the viewport and for the guard band
+    std::vector<Uint8> viewportCodes;
+    std::vector<Uint8> guardBandCodes;
+
+    void resize(int count);
+    ClipVertex clipVertex(int index) const;
+    ScreenVertex screenVertex(int index) const;
+};
+
+struct ClipRect
+{
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+// Value of an attribute over the screen : dx * x + dy * y + c
+struct AttributePlane
+{
+    float dx;
+    float dy;
+    float c;
+
+    float at(float x, float y) const { return dx * x + dy * y + c; }
+};
+
+struct TriangleSetup
+{
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    float minZ;
+
+    // Screen positions sorted by y for the scanline rasterizer
+    glm::vec2 top;
+    glm::vec2 middle;
+    glm::vec2 bottom;
+    bool longEdgeLeft;
+
+    // Edge functions for the half-space rasterizer
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float threshold[3];
+
+    AttributePlane z;
+    AttributePlane ndotl;
+    AttributePlane inverseW;
+    AttributePlane uOverW;
+    AttributePlane vOverW;
+};
+
+struct BinnedTriangle
+{
+    TriangleSetup setup;
+    const Texture *texture;
+};
+
+// Visible mesh with its distance to the camera, used to draw front to back
+struct MeshDraw
+{
+    float distance;
+    int mesh;
+    glm::mat4 modelMatrix;
+};
+
+// What happened to the triangles submitted during the last frame
+struct FrameStatistics
+{
+    int meshes = 0;
+    // Rejected by their bounds before any vertex work
+    int culledMeshes = 0;
+    int triangles = 0;
+    int offScreen = 0;
+    int backFacing = 0;
+    int degenerate = 0;
+    int subPixel = 0;
+    // Crossed the near or far plane or the guard band
+    int clipped = 0;
+    // Reached the rasterizers, including the pieces produced by clipping
+    int rasterized = 0;
+    // Triangle and tile pairs skipped by the hierarchical depth test
+    int occluded = 0;
 };
-}
 
 class Device
 {
 private:
     int m_width;
     int m_height;
+
+    // Hierarchical depth : farthest depth of every 8x8 block of the depth buffer.
+    // It only ever has to be conservative, since depth writes can only bring it closer.
+    static const int BLOCK_SIZE = 8;
+    int m_blocksX;
+    int m_blocksY;
+
+    // Color, depth and visibility are stored in m_layout order
+    FramebufferLayout m_layout = FramebufferLayout::Linear;
+    // Requested by setLayout, applied by clear so a frame never mixes layouts
+    FramebufferLayout m_pendingLayout = FramebufferLayout::Linear;
+    int m_bufferSize;
     Color *m_back_buffer;
     float *m_depthBuffer;
+    // Index in m_triangles of the triangle visible in every pixel
+    Uint32 *m_visibilityBuffer;
+    static const Uint32 NO_TRIANGLE = 0xffffffff;
+    // Linear copy of a tiled back buffer
+    Color *m_resolveBuffer;
+
+    static const int TILE_SIZE = 64;
+    int m_tilesX;
+    int m_tilesY;
+    TransformedVertices m_vertices;
+    std::vector<BinnedTriangle> m_triangles;
+    std::vector<MeshDraw> m_drawOrder;
+    std::vector<std::vector<int>> m_tileBins;
+    // Whether the tile was cleared since the last clear(), which only records m_clearColor
+    std::vector<Uint8> m_tileInitialized;
+    Color m_clearColor = Color::Black;
+
+    std::vector<float> m_blockDepth;
+
+    RasterizerType m_rasterizer = RasterizerType::HalfSpace;
+    RenderMode m_renderMode = RenderMode::Forward;
+    FrameStatistics m_statistics;
+    TextureCache m_textureCache;
+    bool m_optimizeMeshes = false;
 
+    int rowIndex(int y) const
+    {
+        if(m_layout == FramebufferLayout::Linear)
+            return y * m_width;
+        return (y / BLOCK_SIZE) * m_blocksX * BLOCK_SIZE * BLOCK_SIZE + (y % BLOCK_SIZE) * BLOCK_SIZE;
+    }
+    int columnOffset(int x) const
+    {
+        if(m_layout == FramebufferLayout::Linear)
+            return x;
+        return (x / BLOCK_SIZE) * BLOCK_SIZE * BLOCK_SIZE + x % BLOCK_SIZE;
+    }
+    int pixelIndex(int x, int y) const { return this->rowIndex(y) + this->columnOffset(x); }
+
+    ClipRect tileRect(int tile) const;
+    void initializeTile(int tile);
+    void initializeTiles(const ClipRect& rect);
     void putPixel(int x, int y, float z, const Color color);
-    Vertex project(Vertex& coord, glm::mat4& MVP, glm::mat4& modelMatrix);
-    void proccessScanLine(ScanLineData y, Vertex& v1, Vertex& v2, Vertex& v3,Vertex& v4, Color color, const Texture& texture);
+    void updateBlockDepth(int blockX, int blockY);
+    bool isOccluded(const TriangleSetup& setup, const ClipRect& clip) const;
+    void transformVertices(Mesh& mesh, const glm::mat4& MVP, const glm::mat4& modelMatrix);
+    ScreenVertex project(const ClipVertex& vertex);
+    void clipTriangle(const ClipVertex& v1, const ClipVertex& v2, const ClipVertex& v3, int clipMask, const Texture& texture);
+    void emitTriangle(const ScreenVertex& v1, const ScreenVertex& v2, const ScreenVertex& v3, const Texture& texture);
+    void setupTriangles(Mesh& mesh);
+    void binTriangles();
+    template<PixelOutput output>
+    void proccessScanLine(int y, const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id);
+    template<PixelOutput output>
+    void drawTriangle(const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id);
+    template<PixelOutput output>
+    void drawTriangleHalfSpace(const TriangleSetup& setup, Color color, const Texture& texture, const ClipRect& clip, Uint32 id);
+    template<PixelOutput output>
+    void rasterize(const BinnedTriangle& triangle, Uint32 id, const ClipRect& clip);
+    int drawTile(int tile);
+    void shadeVisibility(const ClipRect& clip);
+    void optimizeMeshes(std::vector<Mesh>& meshes, size_t first);
 public:
     Device(int width, int height);
     ~Device();
@@ -50,17 +254,39 @@ public:
     Device& operator=(const Device& other) = delete;
 
     void loadJSONFile(std::string filename, std::vector<Mesh>& meshes);
+    // Binary scene written by saveSceneFile(), see scenefile.h.
+    // Returns false quietly when the file does not exist, and reports files that fail validation.
+    bool loadSceneFile(std::string filename, std::vector<Mesh>& meshes);
+    TextureCache& textureCache() { return m_textureCache; }
+
+    // Reorders the meshes loaded from then on for vertex cache reuse, see meshoptimizer.h
+    bool optimizeMeshes() const { return m_optimizeMeshes; }
+    void setOptimizeMeshes(bool optimize) { m_optimizeMeshes = optimize; }
 
     void clear(const Color color);
 
-    Color* backBuffer() const { return m_back_buffer; }
+    // Linear back buffer, complete only after resolve()
+    Color* backBuffer() const { return m_layout == FramebufferLayout::Linear ? m_back_buffer : m_resolveBuffer; }
+    void resolve();
+
+    // The layout in use, a new one set with setLayout takes effect from the next clear
+    FramebufferLayout layout() const { return m_layout; }
+    void setLayout(FramebufferLayout layout) { m_pendingLayout = layout; }
+
+    RasterizerType rasterizer() const { return m_rasterizer; }
+    void setRasterizer(RasterizerType rasterizer) { m_rasterizer = rasterizer; }
+
+    RenderMode renderMode() const { return m_renderMode; }
+    void setRenderMode(RenderMode mode) { m_renderMode = mode; }
+
+    const FrameStatistics& statistics() const { return m_statistics; }
 
     void render(const SoftEngine::Camera& camera, std::vector<Mesh>& meshes);
 
     void drawPoint(glm::vec3 point, Color color);
     void drawLine(glm::vec3 start, glm::vec3 end, Color color);
     void drawBLine(glm::vec3 start, glm::vec3 end, Color color);
-    void drawTriangle(Vertex v1, Vertex v2, Vertex v3, Color color, const Texture& texture);
+    void drawTriangle(const ScreenVertex& v1, const ScreenVertex& v2, const ScreenVertex& v3, Color color, const Texture& texture);
 };
 }//end of namespace
 
@@ -1,18 +1,10 @@
 #include "json.h"
 #include <stdlib.h>
 #include <string>
-#include <algorithm>
 #include <cstdlib>
 #include <cstdio>
 #include <climits>
 #include <string.h>
-#include <functional>
-#include <cctype>
-#include <stack>
-
-#ifndef WIN32
-#define _stricmp strcasecmp
-#endif
 
 #ifdef _MSC_VER
 #define snprintf sprintf_s
@@ -20,131 +12,24 @@
 
 using namespace json;
 
-namespace json
-{
-	enum StackDepthType
-	{
-		InObject,
-		InArray
-	};
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Helper functions
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static std::string Trim(const std::string& str)
-{
-	std::string s = str;
-	
-	// remove white space in front
-	s.erase(s.begin(), std::find_if(s.begin(), s.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
-	
-	// remove trailing white space
-	s.erase(std::find_if(s.rbegin(), s.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
-	
-	return s;
-}
-
-// Finds the position of the first " character that is NOT preceeded immediately by a \ character.
-// In JSON, \" is valid and has a different meaning than the escaped " character.
-static size_t GetQuotePos(const std::string& str, size_t start_pos = 0)
-{
-	bool found_slash = false;
-	for (size_t i = start_pos; i < str.length(); i++)
-	{
-		char c = str[i];
-		if ((c == '\\') && !found_slash)
-		{
-			found_slash = true;
-			continue;
-		}
-		else if ((c == '\"') && !found_slash)
-			return i;
-		
-		found_slash = false;
-	}
-	
-	return std::string::npos;
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-Value::Value(const Value& v) : mValueType(v.mValueType)
-{
-	switch (mValueType)
-	{
-		case StringVal		: mStringVal = v.mStringVal; break;
-		case IntVal			: mIntVal = v.mIntVal; mFloatVal = (float)v.mIntVal; mDoubleVal = (double)v.mIntVal; break;
-		case FloatVal		: mFloatVal = v.mFloatVal; mIntVal = (int)v.mFloatVal; mDoubleVal = (double)v.mDoubleVal; break;
-		case DoubleVal		: mDoubleVal = v.mDoubleVal; mIntVal = (int)v.mDoubleVal; mFloatVal = (float)v.mDoubleVal; break;
-		case BoolVal		: mBoolVal = v.mBoolVal; break;
-		case ObjectVal		: mObjectVal = v.mObjectVal; break;
-		case ArrayVal		: mArrayVal = v.mArrayVal; break;
-		default				: break;
-	}
-}
-
-Value& Value::operator =(const Value& v)
-{
-	if (&v == this)
-		return *this;
-
-	mValueType = v.mValueType;
-
-	switch (mValueType)
-	{
-		case StringVal		: mStringVal = v.mStringVal; break;
-		case IntVal			: mIntVal = v.mIntVal; mFloatVal = (float)v.mIntVal; mDoubleVal = (double)v.mIntVal; break;
-		case FloatVal		: mFloatVal = v.mFloatVal; mIntVal = (int)v.mFloatVal; mDoubleVal = (double)v.mDoubleVal; break;
-		case DoubleVal		: mDoubleVal = v.mDoubleVal; mIntVal = (int)v.mDoubleVal; mFloatVal = (float)v.mDoubleVal; break;
-		case BoolVal		: mBoolVal = v.mBoolVal; break;
-		case ObjectVal		: mObjectVal = v.mObjectVal; break;
-		case ArrayVal		: mArrayVal = v.mArrayVal; break;
-		default				: break;
-	}
-
-	return *this;
-}
-
-Value& Value::operator [](size_t idx)
+const Value& Value::Null()
 {
-	assert(mValueType == ArrayVal);
-	return mArrayVal[idx];
+	static const Value null_value;
+	return null_value;
 }
 
 const Value& Value::operator [](size_t idx) const
 {
 	assert(mValueType == ArrayVal);
-	return mArrayVal[idx];
-}
-
-Value& Value::operator [](const std::string& key)
-{
-	assert(mValueType == ObjectVal);
-	return mObjectVal[key];
-}
-
-Value& Value::operator [](const char* key)
-{
-	assert(mValueType == ObjectVal);
-	return mObjectVal[key];
-}
-
-const Value& Value::operator [](const char* key) const
-{
-	assert(mValueType == ObjectVal);
-	return mObjectVal[key];
+	return ToArray()[idx];
 }
 
-const Value& Value::operator [](const std::string& key) const
+const Value& Value::operator [](const StringView& key) const
 {
 	assert(mValueType == ObjectVal);
-	return mObjectVal[key];
-}
-
-void Value::Clear()
-{
-	mValueType = NULLVal;
+	return ToObject()[key];
 }
 
 size_t Value::size() const
@@ -152,662 +37,668 @@ size_t Value::size() const
 	if ((mValueType != ObjectVal) && (mValueType != ArrayVal))
 		return 1;
 
-	return mValueType == ObjectVal ? mObjectVal.size() : mArrayVal.size();
+	return mSize;
 }
 
-bool Value::HasKey(const std::string &key) const
+bool Value::HasKey(const StringView& key) const
 {
 	assert(mValueType == ObjectVal);
-	return mObjectVal.HasKey(key);
+	return ToObject().HasKey(key);
 }
 
-int Value::HasKeys(const std::vector<std::string> &keys) const
+int Value::HasKeys(const std::vector<std::string>& keys) const
 {
 	assert(mValueType == ObjectVal);
-	return mObjectVal.HasKeys(keys);
+	return ToObject().HasKeys(keys);
 }
 
-int Value::HasKeys(const char **keys, int key_count) const
+int Value::HasKeys(const char** keys, int key_count) const
 {
 	assert(mValueType == ObjectVal);
-	return mObjectVal.HasKeys(keys, key_count);
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-Array::Array()
-{
+	return ToObject().HasKeys(keys, key_count);
 }
 
-Array::Array(const Array& a) : mValues(a.mValues)
+bool json::operator ==(const Value& lhs, const Value& rhs)
 {
-}
-
-Array& Array::operator =(const Array& a)
-{
-	if (&a == this)
-		return *this;
-
-	Clear();
-	mValues = a.mValues;
+	if (lhs.IsNumeric() || rhs.IsNumeric())
+		return lhs.IsNumeric() && rhs.IsNumeric() && (lhs.ToDouble() == rhs.ToDouble());
 
-	return *this;
-}
+	if (lhs.GetType() != rhs.GetType())
+		return false;
 
-Value& Array::operator [](size_t i)
-{
-	return mValues[i];
-}
+	switch (lhs.GetType())
+	{
+		case StringVal		: 	return lhs.ToString() == rhs.ToString();
 
-const Value& Array::operator [](size_t i) const
-{
-	return mValues[i];
-}
+		case BoolVal		: 	return lhs.ToBool() == rhs.ToBool();
 
+		case ArrayVal		:
+		{
+			ArrayView a = lhs.ToArray();
+			ArrayView b = rhs.ToArray();
+			if (a.size() != b.size())
+				return false;
 
-Array::ValueVector::const_iterator Array::begin() const
-{
-	return mValues.begin();
-}
+			for (size_t i = 0; i < a.size(); i++)
+				if (a[i] != b[i])
+					return false;
 
-Array::ValueVector::const_iterator Array::end() const
-{
-	return mValues.end();
-}
+			return true;
+		}
 
-Array::ValueVector::iterator Array::begin()
-{
-	return mValues.begin();
-}
+		case ObjectVal		:
+		{
+			ObjectView a = lhs.ToObject();
+			ObjectView b = rhs.ToObject();
+			if (a.size() != b.size())
+				return false;
 
-Array::ValueVector::iterator Array::end()
-{
-	return mValues.end();
-}
+			for (ObjectView::const_iterator it = a.begin(); it != a.end(); it++)
+			{
+				ObjectView::const_iterator other = b.find(it->key);
+				if ((other == b.end()) || (it->value != other->value))
+					return false;
+			}
 
-void Array::push_back(const Value& v)
-{
-	mValues.push_back(v);
-}
+			return true;
+		}
 
-void Array::insert(size_t index, const Value& v)
-{
-	mValues.insert(mValues.begin() + index, v);
+		default:
+			return true;
+	}
 }
 
-size_t Array::size() const
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+const Value& ObjectView::operator [](const StringView& key) const
 {
-	return mValues.size();
+	const_iterator it = find(key);
+	return it == end() ? Value::Null() : it->value;
 }
 
-void Array::Clear()
+ObjectView::const_iterator ObjectView::find(const StringView& key) const
 {
-	mValues.clear();
-}
+	for (size_t i = mSize; i > 0; i--)
+	{
+		// Interned keys of the same document are found by their address
+		if (mMembers[i - 1].key == key)
+			return mMembers + i - 1;
+	}
 
-Array::ValueVector::iterator Array::find(const Value& v)
-{
-	return std::find(mValues.begin(), mValues.end(), v);
+	return end();
 }
 
-Array::ValueVector::const_iterator Array::find(const Value& v) const
+int ObjectView::HasKeys(const std::vector<std::string>& keys) const
 {
-	return std::find(mValues.begin(), mValues.end(), v);
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		if (!HasKey(keys[i]))
+			return (int)i;
+	}
+	
+	return -1;
 }
 
-bool Array::HasValue(const Value& v) const
+int ObjectView::HasKeys(const char** keys, int key_count) const
 {
-	return find(v) != end();
+	for (int i = 0; i < key_count; i++)
+		if (!HasKey(keys[i]))
+			return i;
+	
+	return -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-Object::Object()
-{
-}
+static const size_t ARENA_ALIGNMENT = sizeof(double);
 
-Object::Object(const Object& obj) : mValues(obj.mValues)
+Arena::Arena() : mCurrent(0), mRemaining(0), mUsed(0)
 {
-
 }
 
-Object& Object::operator =(const Object& obj)
+Arena::~Arena()
 {
-	if (&obj == this)
-		return *this;
-
 	Clear();
-	mValues = obj.mValues;
-
-	return *this;
 }
 
-Value& Object::operator [](const std::string& key)
+void* Arena::Allocate(size_t size)
 {
-	return mValues[key];
-}
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+	mUsed += size;
 
-const Value& Object::operator [](const std::string& key) const
-{
-	ValueMap::const_iterator it = mValues.find(key);
-	return it->second;
-}
+	// Large allocations get their own block, so the current one keeps its space
+	if (size > BLOCK_SIZE / 4)
+	{
+		char* block = (char*)malloc(size);
+		mBlocks.insert(mBlocks.end() - (mCurrent ? 1 : 0), block);
+		return block;
+	}
 
-Value& Object::operator [](const char* key)
-{
-	return mValues[key];
-}
+	if (size > mRemaining)
+	{
+		mCurrent = (char*)malloc(BLOCK_SIZE);
+		mRemaining = BLOCK_SIZE;
+		mBlocks.push_back(mCurrent);
+	}
 
-const Value& Object::operator [](const char* key) const
-{
-	ValueMap::const_iterator it = mValues.find(key);
-	return it->second;
+	void* p = mCurrent;
+	mCurrent += size;
+	mRemaining -= size;
+	return p;
 }
 
-Object::ValueMap::const_iterator Object::begin() const
+void Arena::Clear()
 {
-	return mValues.begin();
-}
+	for (size_t i = 0; i < mBlocks.size(); i++)
+		free(mBlocks[i]);
 
-Object::ValueMap::const_iterator Object::end() const
-{
-	return mValues.end();
+	mBlocks.clear();
+	mCurrent = 0;
+	mRemaining = 0;
+	mUsed = 0;
 }
 
-Object::ValueMap::iterator Object::begin()
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FNV-1a
+static size_t HashKey(const StringView& key)
 {
-	return mValues.begin();
-}
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < key.size(); i++)
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
 
-Object::ValueMap::iterator Object::end()
-{
-	return mValues.end();
+	return hash;
 }
 
-Object::ValueMap::iterator Object::find(const std::string& key)
+Document::Document() : mKeyCount(0), mCursor(0), mText(0), mErrorOffset(0)
 {
-	return mValues.find(key);
 }
 
-Object::ValueMap::const_iterator Object::find(const std::string& key) const
+void Document::Clear()
 {
-	return mValues.find(key);
+	mArena.Clear();
+	mRoot = Value();
+	mKeys.clear();
+	mKeyCount = 0;
+	mValueStack.clear();
+	mMemberStack.clear();
+	mCursor = 0;
+	mText = 0;
+	mError.clear();
+	mErrorOffset = 0;
 }
 
-bool Object::HasKey(const std::string& key) const
+StringView Document::InternKey(const StringView& key)
 {
-	return find(key) != end();
-}
+	// Kept at most half full
+	if ((mKeyCount + 1) * 2 > mKeys.size())
+	{
+		std::vector<StringView> keys(mKeys.empty() ? 64 : mKeys.size() * 2, StringView(0, 0));
+		for (size_t i = 0; i < mKeys.size(); i++)
+		{
+			if (!mKeys[i].data())
+				continue;
 
-int Object::HasKeys(const std::vector<std::string>& keys) const
-{
-	for (size_t i = 0; i < keys.size(); i++)
+			size_t slot = HashKey(mKeys[i]) & (keys.size() - 1);
+			while (keys[slot].data())
+				slot = (slot + 1) & (keys.size() - 1);
+			keys[slot] = mKeys[i];
+		}
+		mKeys.swap(keys);
+	}
+
+	size_t slot = HashKey(key) & (mKeys.size() - 1);
+	while (mKeys[slot].data())
 	{
-		if (!HasKey(keys[i]))
-			return (int)i;
+		if (mKeys[slot] == key)
+			return mKeys[slot];
+		slot = (slot + 1) & (mKeys.size() - 1);
 	}
-	
-	return -1;
-}
 
-int Object::HasKeys(const char** keys, int key_count) const
-{
-	for (int i = 0; i < key_count; i++)
-		if (!HasKey(keys[i]))
-			return i;
-	
-	return -1;
+	mKeys[slot] = key;
+	mKeyCount++;
+	return key;
 }
 
-void Object::Clear()
+StringView Document::Key(const StringView& key) const
 {
-	mValues.clear();
-}
+	if (mKeys.empty())
+		return key;
 
+	size_t slot = HashKey(key) & (mKeys.size() - 1);
+	while (mKeys[slot].data())
+	{
+		if (mKeys[slot] == key)
+			return mKeys[slot];
+		slot = (slot + 1) & (mKeys.size() - 1);
+	}
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-std::string SerializeArray(const Array& a);
+	return key;
+}
 
-std::string SerializeValue(const Value& v)
+bool Document::Fail(const char* error)
 {
-	std::string str;
-
-	static const int BUFF_SZ = 500;
-	char buff[BUFF_SZ];
-	switch (v.GetType())
+	if (mError.empty())
 	{
-		case IntVal			: snprintf(buff, BUFF_SZ, "%d", (int)v); str = buff; break;
-		case FloatVal		: snprintf(buff, BUFF_SZ, "%f", (float)v); str = buff; break;
-		case DoubleVal		: snprintf(buff, BUFF_SZ, "%f", (double)v); str = buff; break;
-		case BoolVal		: str = v ? "true" : "false"; break;
-		case NULLVal		: str = "null"; break;
-		case ObjectVal		: str = Serialize(v); break;
-		case ArrayVal		: str = SerializeArray(v); break;
-		case StringVal		: str = std::string("\"") + (std::string)v + std::string("\""); break;
+		mError = error;
+		mErrorOffset = mCursor - mText;
 	}
 
-	return str;
+	return false;
 }
 
-std::string SerializeArray(const Array& a)
+void Document::SkipWhitespace()
 {
-	std::string str = "[";
+	while ((*mCursor == ' ') || (*mCursor == '\n') || (*mCursor == '\r') || (*mCursor == '\t'))
+		mCursor++;
+}
 
-	bool first = true;
-	for (size_t i = 0; i < a.size(); i++)
-	{
-		const Value& v = a[i];
-		if (!first)
-			str += std::string(",");
+bool Document::Parse(const char* text, size_t length)
+{
+	Clear();
 
-		str += SerializeValue(v);
+	// The only copy of the text, strings are unescaped in place and point into it
+	char* copy = (char*)mArena.Allocate(length + 1);
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	mText = copy;
+	mCursor = copy;
 
-		first = false;
+	Value root;
+	bool parsed = ParseValue(root, 0);
+	if (parsed)
+	{
+		SkipWhitespace();
+		if (mCursor != copy + length)
+			parsed = Fail("Unexpected characters after the value");
 	}
 
-	str += "]";
-	return str;
+	mValueStack.clear();
+	mMemberStack.clear();
+	if (parsed)
+		mRoot = root;
+
+	return parsed;
 }
 
-std::string json::Serialize(const Value& v)
+bool Document::ParseValue(Value& v, int depth)
 {
-	std::string str;
+	if (depth > MAX_DEPTH)
+		return Fail("Too deeply nested");
 
-	bool first = true;
-	
-	if (v.GetType() == ObjectVal)
+	SkipWhitespace();
+	switch (*mCursor)
 	{
-		str = "{";
-		Object obj = v.ToObject();
-		for (Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); it++)
+		case '{'	:	return ParseObject(v, depth + 1);
+		case '['	:	return ParseArray(v, depth + 1);
+		case '\"'	:
 		{
-			if (!first)
-				str += std::string(",");
-
-			str += std::string("\"") + it->first + std::string("\":") + SerializeValue(it->second);
-			first = false;
+			StringView str;
+			if (!ParseString(str))
+				return false;
+
+			v.mValueType = StringVal;
+			v.mStringVal = str.data();
+			v.mSize = (unsigned int)str.size();
+			return true;
 		}
+		case 't'	:
+			if (strncmp(mCursor, "true", 4) != 0)
+				return Fail("Invalid literal");
+			mCursor += 4;
+			v = Value(true);
+			return true;
 
-		str += "}";
-	}
-	else if (v.GetType() == ArrayVal)
-	{
-		str = "[";
-		Array a = v.ToArray();
-		for (Array::ValueVector::const_iterator it = a.begin(); it != a.end(); it++)
-		{
-			if (!first)
-				str += std::string(",");
-			
-			str += SerializeValue(*it);
-			first = false;
-		}
-		
-		str += "]";
-			
+		case 'f'	:
+			if (strncmp(mCursor, "false", 5) != 0)
+				return Fail("Invalid literal");
+			mCursor += 5;
+			v = Value(false);
+			return true;
+
+		case 'n'	:
+			if (strncmp(mCursor, "null", 4) != 0)
+				return Fail("Invalid literal");
+			mCursor += 4;
+			v = Value();
+			return true;
+
+		default		:	return ParseNumber(v);
 	}
-	//else error
-	
-	return str;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static Value DeserializeArray(std::string& str, std::stack<StackDepthType>& depth_stack);
-static Value DeserializeObj(const std::string& _str, std::stack<StackDepthType>& depth_stack);
+static int HexDigit(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	return -1;
+}
 
-static Value DeserializeInternal(const std::string& _str, std::stack<StackDepthType>& depth_stack)
+static bool ReadHex4(const char* str, unsigned int& value)
 {
-	Value v;
-	
-	std::string str = Trim(_str);
-	if (str[0] == '{')
-	{
-		// Error: Began with a { but doesn't end with one
-		if (str[str.length() - 1] != '}')
-			return Value();
-		
-		depth_stack.push(InObject);
-		v = DeserializeObj(str, depth_stack);
-		if ((v.GetType() == NULLVal) || (depth_stack.top() != InObject))
-			return v;
-		
-		depth_stack.pop();
-	}
-	else if (str[0] == '[')
-	{
-		// Error: Began with a [ but doesn't end with one
-		if (str[str.length() - 1] != ']')
-			return Value();
-		
-		depth_stack.push(InArray);
-		v = DeserializeArray(str, depth_stack);
-		if ((v.GetType() == NULLVal) || (depth_stack.top() != InArray))
-			return v;
-		
-		depth_stack.pop();
-	}
-	else
+	value = 0;
+	for (int i = 0; i < 4; i++)
 	{
-		// Will never get here unless _str is not valid JSON
-		return Value();
+		int digit = HexDigit(str[i]);
+		if (digit < 0)
+			return false;
+		value = (value << 4) | digit;
 	}
-	
-	return v;
+
+	return true;
 }
 
-static size_t GetEndOfArrayOrObj(const std::string& str, std::stack<StackDepthType>& depth_stack)
+// Unescapes in place : every escape sequence is at least as long as what it stands for
+bool Document::ParseString(StringView& str)
 {
-	size_t i = 1;
-	bool in_quote = false;
-	size_t original_count = depth_stack.size();
-	
-	for (; i < str.length(); i++)
+	char* begin = ++mCursor;
+	char* out = begin;
+
+	for (;;)
 	{
-		if (str[i] == '\"')
+		char c = *mCursor;
+		if (c == '\"')
+			break;
+		if (c == '\0')
+			return Fail("Unterminated string");
+
+		mCursor++;
+		if (c != '\\')
 		{
-			if (str[i - 1] != '\\')
-				in_quote = !in_quote;
+			*out++ = c;
+			continue;
 		}
-		else if (!in_quote)
+
+		c = *mCursor++;
+		switch (c)
 		{
-			if (str[i] == '[')
-				depth_stack.push(InArray);
-			else if (str[i] == '{')
-				depth_stack.push(InObject);
-			else if (str[i] == ']')
+			case '\"'	: 	*out++ = '\"'; break;
+			case '\\'	: 	*out++ = '\\'; break;
+			case '/'	: 	*out++ = '/'; break;
+			case 't'	: 	*out++ = '\t'; break;
+			case 'n'	: 	*out++ = '\n'; break;
+			case 'r'	: 	*out++ = '\r'; break;
+			case 'b'	:	*out++ = '\b'; break;
+			case 'f'	: 	*out++ = '\f'; break;
+			case 'u'	:
 			{
-				StackDepthType t = depth_stack.top();
-				if (t != InArray)
+				unsigned int code;
+				if (!ReadHex4(mCursor, code))
+					return Fail("Invalid unicode escape");
+				mCursor += 4;
+
+				// Surrogate pair
+				unsigned int low;
+				if ((code >= 0xD800) && (code < 0xDC00) && (mCursor[0] == '\\') && (mCursor[1] == 'u') &&
+					ReadHex4(mCursor + 2, low) && (low >= 0xDC00) && (low < 0xE000))
 				{
-					// expected to be closing an array but instead we're inside an object block.
-					// Example problem: {]}
-					return std::string::npos;
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					mCursor += 6;
 				}
-				
-				size_t count = depth_stack.size();
-				depth_stack.pop();
-				if (count == original_count)
-					break;
-			}
-			else if (str[i] == '}')
-			{
-				StackDepthType t = depth_stack.top();
-				if (t != InObject)
+
+				// UTF-8
+				if (code < 0x80)
+					*out++ = (char)code;
+				else if (code < 0x800)
+				{
+					*out++ = (char)(0xC0 | (code >> 6));
+					*out++ = (char)(0x80 | (code & 0x3F));
+				}
+				else if (code < 0x10000)
+				{
+					*out++ = (char)(0xE0 | (code >> 12));
+					*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+					*out++ = (char)(0x80 | (code & 0x3F));
+				}
+				else
 				{
-					// expected to be closing an object but instead we're inside an array.
-					// Example problem: [}]
-					return std::string::npos;
+					*out++ = (char)(0xF0 | (code >> 18));
+					*out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+					*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+					*out++ = (char)(0x80 | (code & 0x3F));
 				}
-					
-				size_t count = depth_stack.size();
-				depth_stack.pop();
-				if (count == original_count)
-					break;
+				break;
 			}
+
+			default		:	return Fail("Invalid escape sequence");
 		}
 	}
-	
-	return i;
+
+	// Overwrites at most the closing quote
+	*out = '\0';
+	mCursor++;
+	str = StringView(begin, out - begin);
+	return true;
 }
 
-static std::string UnescapeJSONString(const std::string& str)
+bool Document::ParseNumber(Value& v)
 {
-	std::string s = "";
-	
-	for (int i = 0; i < str.length(); i++)
+	const char* begin = mCursor;
+	const char* p = mCursor;
+	bool is_integer = true;
+
+	if (*p == '-')
+		p++;
+	if ((*p < '0') || (*p > '9'))
+		return Fail("Unexpected character");
+	while ((*p >= '0') && (*p <= '9'))
+		p++;
+	if (*p == '.')
 	{
-		char c = str[i];
-		if ((c == '\\') && (i + 1 < str.length()))
-		{
-			int skip_ahead = 1;
-			unsigned int hex;
-			std::string hex_str;
-			
-			switch (str[i+1])
-			{
-				case '"' : 	s.push_back('\"'); break;
-				case '\\': 	s.push_back('\\'); break;
-				case '/' : 	s.push_back('/'); break;
-				case 't' : 	s.push_back('\t'); break;
-				case 'n' : 	s.push_back('\n'); break;
-				case 'r' : 	s.push_back('\r'); break;
-				case 'b' :	s.push_back('\b'); break;
-				case 'f' : 	s.push_back('\f'); break;
-				case 'u' : 	skip_ahead = 5;
-					hex_str = str.substr(i + 4, 2);
-					hex = (unsigned int)std::strtoul(hex_str.c_str(), nullptr, 16);
-					s.push_back((char)hex);
-					break;
-					
-				default: break;
-			}
-			
-			i += skip_ahead;
-		}
-		else
-			s.push_back(c);
+		is_integer = false;
+		p++;
+		if ((*p < '0') || (*p > '9'))
+			return Fail("Invalid number");
+		while ((*p >= '0') && (*p <= '9'))
+			p++;
+	}
+	if ((*p == 'e') || (*p == 'E'))
+	{
+		is_integer = false;
+		p++;
+		if ((*p == '+') || (*p == '-'))
+			p++;
+		if ((*p < '0') || (*p > '9'))
+			return Fail("Invalid number");
+		while ((*p >= '0') && (*p <= '9'))
+			p++;
 	}
-	
-	return Trim(s);
-}
 
-static Value DeserializeValue(std::string& str, bool* had_error, std::stack<StackDepthType>& depth_stack)
-{
-	Value v;
+	// The text is zero terminated, strtod stops at the end of the number
+	double value = strtod(begin, 0);
+	mCursor = (char*)p;
 
-	*had_error = false;
-	str = Trim(str);
+	// Integers beyond the size of an int are stored as doubles
+	if (is_integer && (value >= (double)INT_MIN) && (value <= (double)INT_MAX))
+		v = Value((int)value);
+	else
+		v = Value(value);
 
-	if (str.length() == 0)
-		return v;
+	return true;
+}
 
-	if (str[0] == '[')
+bool Document::ParseArray(Value& v, int depth)
+{
+	mCursor++;
+	size_t base = mValueStack.size();
+
+	SkipWhitespace();
+	if (*mCursor != ']')
 	{
-		depth_stack.push(InArray);
-		size_t i = GetEndOfArrayOrObj(str, depth_stack);
-		if (i == std::string::npos)
+		for (;;)
 		{
-			*had_error = true;
-			return Value();
+			Value element;
+			if (!ParseValue(element, depth))
+				return false;
+			mValueStack.push_back(element);
+
+			SkipWhitespace();
+			if (*mCursor == ']')
+				break;
+			if (*mCursor != ',')
+				return Fail("Expected , or ]");
+			mCursor++;
 		}
-		
-		std::string array_str = str.substr(0, i + 1);
-		v = Value(DeserializeArray(array_str, depth_stack));
-		str = str.substr(i + 1, str.length());
 	}
-	else if (str[0] == '{')
+	mCursor++;
+
+	// The elements end up next to each other in the arena
+	size_t count = mValueStack.size() - base;
+	Value* elements = 0;
+	if (count > 0)
 	{
-		depth_stack.push(InObject);
-		size_t i = GetEndOfArrayOrObj(str, depth_stack);
+		elements = (Value*)mArena.Allocate(count * sizeof(Value));
+		memcpy(elements, &mValueStack[base], count * sizeof(Value));
+		mValueStack.resize(base);
+	}
 
-		if (i == std::string::npos)
-		{
-			*had_error = true;
-			return Value();
-		}
+	v.mValueType = ArrayVal;
+	v.mArrayVal = elements;
+	v.mSize = (unsigned int)count;
+	return true;
+}
 
-		std::string obj_str = str.substr(0, i + 1);
-		v = Value(DeserializeInternal(obj_str, depth_stack));
-		str = str.substr(i + 1, str.length());
-	}
-	else if (str[0] == '\"')
+bool Document::ParseObject(Value& v, int depth)
+{
+	mCursor++;
+	size_t base = mMemberStack.size();
+
+	SkipWhitespace();
+	if (*mCursor != '}')
 	{
-		size_t end_quote = GetQuotePos(str, 1);
-		if (end_quote == std::string::npos)
+		for (;;)
 		{
-			*had_error = true;
-			return Value();
+			SkipWhitespace();
+			if (*mCursor != '\"')
+				return Fail("Expected a key");
+
+			Member member;
+			if (!ParseString(member.key))
+				return false;
+			member.key = InternKey(member.key);
+
+			SkipWhitespace();
+			if (*mCursor != ':')
+				return Fail("Expected :");
+			mCursor++;
+
+			if (!ParseValue(member.value, depth))
+				return false;
+			mMemberStack.push_back(member);
+
+			SkipWhitespace();
+			if (*mCursor == '}')
+				break;
+			if (*mCursor != ',')
+				return Fail("Expected , or }");
+			mCursor++;
 		}
+	}
+	mCursor++;
 
-		v = Value(UnescapeJSONString(str.substr(1, end_quote - 1)));
-		str = str.substr(end_quote + 1, str.length());
+	size_t count = mMemberStack.size() - base;
+	Member* members = 0;
+	if (count > 0)
+	{
+		members = (Member*)mArena.Allocate(count * sizeof(Member));
+		memcpy(members, &mMemberStack[base], count * sizeof(Member));
+		mMemberStack.resize(base);
 	}
-	else
+
+	v.mValueType = ObjectVal;
+	v.mObjectVal = members;
+	v.mSize = (unsigned int)count;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void SerializeString(const StringView& s, std::string& str)
+{
+	str += '\"';
+	for (size_t i = 0; i < s.size(); i++)
 	{
-		bool has_dot = false;
-		bool has_e = false;
-		std::string temp_val;
-		size_t i = 0;
-		for (; i < str.length(); i++)
+		char c = s[i];
+		switch (c)
 		{
-			if (str[i] == '.')
-				has_dot = true;
-			else if (str[i] == 'e')
-				has_e = true;
-			else if (str[i] == ']')
-			{
-				if (depth_stack.top() != InArray)
-				{
-					*had_error = true;
-					return Value();
-				}
-				
-				depth_stack.pop();
-			}
-			else if (str[i] == '}')
-			{
-				if (depth_stack.top() != InObject)
+			case '\"'	:	str += "\\\""; break;
+			case '\\'	:	str += "\\\\"; break;
+			case '\n'	:	str += "\\n"; break;
+			case '\r'	:	str += "\\r"; break;
+			case '\t'	:	str += "\\t"; break;
+			case '\b'	:	str += "\\b"; break;
+			case '\f'	:	str += "\\f"; break;
+			default		:
+				if ((unsigned char)c < 0x20)
 				{
-					*had_error = true;
-					return Value();
+					char buff[8];
+					snprintf(buff, sizeof(buff), "\\u%04x", (unsigned int)c);
+					str += buff;
 				}
-				
-				depth_stack.pop();
-			}
-			else if (str[i] == ',')
+				else
+					str += c;
 				break;
-
-			if (!std::isspace(str[i]))
-				temp_val += str[i];
 		}
-
-		// store all floating point as doubles. This will also set the float and int values as well.
-		if (_stricmp(temp_val.c_str(), "true") == 0)
-			v = Value(true);
-		else if (_stricmp(temp_val.c_str(), "false") == 0)
-			v = Value(false);
-		else if (has_e || has_dot)
-			v = Value(atof(temp_val.c_str()));
-		else if (_stricmp(temp_val.c_str(), "null") == 0)
-			v = Value();
-		else
-		{
-			// Check if the value is beyond the size of an int and if so, store it as a double
-			double tmp_val = atof(temp_val.c_str());
-			if ((tmp_val >= (double)INT_MIN) && (tmp_val <= (double)INT_MAX))
-				v = Value(atoi(temp_val.c_str()));
-			else
-				v = Value(tmp_val);
-		}
-
-		str = str.substr(i, str.length());
 	}
-
-	return v;
+	str += '\"';
 }
 
-static Value DeserializeArray(std::string& str, std::stack<StackDepthType>& depth_stack)
+static void SerializeValue(const Value& v, std::string& str)
 {
-	Array a;
-	bool had_error = false;
-
-	str = Trim(str);
-
-	if ((str[0] == '[') && (str[str.length() - 1] == ']'))
-		str = str.substr(1, str.length() - 2);
-	else
-		return Value();
-
-	while (str.length() > 0)
+	static const int BUFF_SZ = 64;
+	char buff[BUFF_SZ];
+	switch (v.GetType())
 	{
-		std::string tmp;
-
-		size_t i = 0;
-		for (; i < str.length(); i++)
+		case IntVal			: snprintf(buff, BUFF_SZ, "%d", v.ToInt()); str += buff; break;
+		case FloatVal		:
+		case DoubleVal		: snprintf(buff, BUFF_SZ, "%.17g", v.ToDouble()); str += buff; break;
+		case BoolVal		: str += v.ToBool() ? "true" : "false"; break;
+		case NULLVal		: str += "null"; break;
+		case StringVal		: SerializeString(v.ToString(), str); break;
+		case ArrayVal		:
 		{
-			// If we get to an object or array, parse it:
-			if ((str[i] == '{') || (str[i] == '['))
+			ArrayView a = v.ToArray();
+			str += '[';
+			for (ArrayView::const_iterator it = a.begin(); it != a.end(); it++)
 			{
-				Value v = DeserializeValue(str, &had_error, depth_stack);
-				if (had_error)
-					return Value();
-				
-				if (v.GetType() != NULLVal)
-					a.push_back(v);
-
-				break;
+				if (it != a.begin())
+					str += ',';
+				SerializeValue(*it, str);
 			}
-
-			bool terminate_parsing = false;
-
-			if ((str[i] == ',') || (str[i] == ']'))
-				terminate_parsing = true;			// hit the end of a value, parse it in the next block
-			else
-			{
-				// keep grabbing chars to build up the value
-				tmp += str[i];
-				if  (i == str.length() - 1)
-					terminate_parsing = true; // end of string, finish parsing
-			}
-
-			if (terminate_parsing)
+			str += ']';
+			break;
+		}
+		case ObjectVal		:
+		{
+			ObjectView obj = v.ToObject();
+			str += '{';
+			for (ObjectView::const_iterator it = obj.begin(); it != obj.end(); it++)
 			{
-				Value v = DeserializeValue(tmp, &had_error, depth_stack);
-				if (had_error)
-					return Value();
-				
-				if (v.GetType() != NULLVal)
-					a.push_back(v);
-
-				str = str.substr(i + 1, str.length());
-				break;
+				if (it != obj.begin())
+					str += ',';
+				SerializeString(it->key, str);
+				str += ':';
+				SerializeValue(it->value, str);
 			}
+			str += '}';
+			break;
 		}
 	}
-
-	return a;
 }
 
-static Value DeserializeObj(const std::string& _str, std::stack<StackDepthType>& depth_stack)
+std::string json::Serialize(const Value& v)
 {
-	Object obj;
-
-	std::string str = Trim(_str);
-
-	if ((str[0] != '{') && (str[str.length() - 1] != '}'))
-		return Value();
-	else
-		str = str.substr(1, str.length() - 2);
-
-	while (str.length() > 0)
-	{
-		// Get the key name
-		size_t start_quote_idx = GetQuotePos(str);
-		size_t end_quote_idx = GetQuotePos(str, start_quote_idx + 1);
-		size_t colon_idx = str.find(':', end_quote_idx);
-
-		if ((start_quote_idx == std::string::npos) || (end_quote_idx == std::string::npos) || (colon_idx == std::string::npos))
-			return Value();	// can't find key name
-		
-		std::string key = str.substr(start_quote_idx + 1, end_quote_idx - start_quote_idx - 1);
-		if (key.length() == 0)
-			return Value();
-
-		bool had_error = false;
-		str = str.substr(colon_idx + 1, str.length());
-		obj[key] = DeserializeValue(str, &had_error, depth_stack);
-		if (had_error)
-			return Value();
-	}
-
-	return obj;
+	std::string str;
+	SerializeValue(v, str);
+	return str;
 }
 
-Value json::Deserialize(const std::string &str)
+const Value& json::Deserialize(const std::string& str, Document& document)
 {
-	std::stack<StackDepthType> depth_stack;
-	return DeserializeInternal(str, depth_stack);
+	document.Parse(str);
+	return document.Root();
 }
-
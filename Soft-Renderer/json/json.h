@@ -26,6 +26,27 @@
 
 	CHANGELOG:
 	==========
+	10/18/2026:
+	-----------
+	REDESIGN for large documents, the API changed:
+	* A Value is now a 16 byte tagged union. Arrays, objects and strings are
+		allocated from the arena of a Document, which owns every Value parsed
+		into it. Values are plain handles and copying one never copies its
+		contents, but they must not outlive their Document.
+	* Parsing happens in place in a single copy of the text. Strings point
+		into it, unescaped and zero terminated, and are returned as StringView.
+	* Object keys are interned by the Document, so every occurrence of a key
+		shares the same characters. Document::Key() returns the interned view
+		of a key, which Value::operator[] then matches by address.
+	* ToObject()/ToArray() return ObjectView/ArrayView over the arena, which
+		replace the old Object and Array classes. Objects keep the order of
+		the document, a key repeated in an object resolves to its last value.
+	* Documents are read only, the old building API and the ordering
+		operators are gone. Serialize() escapes strings and writes doubles
+		with all their digits.
+	* Deserialize(str, document) returns the root, a NULLVal Value on error,
+		like before. Document::GetError() tells what went wrong and where.
+
  	2/8/2014:
  	--------- 
  	MAJOR BUG FIXES, all courtesy of Per Rovegård, Ph.D.
@@ -185,8 +206,8 @@
 #define __SUPER_EASY_JSON_H__
 
 #include <vector>
-#include <map>
 #include <string>
+#include <string.h>
 #include <assert.h>
 
 namespace json
@@ -196,333 +217,297 @@ namespace json
 		NULLVal,
 		StringVal,
 		IntVal,
-		FloatVal,
+		FloatVal,		// Never produced by Deserialize, kept for compatibility
 		DoubleVal,
 		ObjectVal,
 		ArrayVal,
 		BoolVal
 	};
 
-	class Value;
-
-	class Object
+	// Characters owned by someone else, usually a Document. Strings coming
+	// from a Document are also zero terminated.
+	class StringView
 	{
-		public:
-
-			typedef std::map<std::string, Value> ValueMap;
-
 		protected:
 
-			ValueMap	mValues;
+			const char*		mData;
+			size_t			mLength;
 
 		public:
 
-			Object();
-			Object(const Object& obj);
-
-			Object& operator =(const Object& obj);
-
-			friend bool operator ==(const Object& lhs, const Object& rhs);
-			inline friend bool operator !=(const Object& lhs, const Object& rhs) 	{return !(lhs == rhs);}
-			friend bool operator <(const Object& lhs, const Object& rhs);
-			inline friend bool operator >(const Object& lhs, const Object& rhs) 	{return operator<(rhs, lhs);}
-			inline friend bool operator <=(const Object& lhs, const Object& rhs)	{return !operator>(lhs, rhs);}
-			inline friend bool operator >=(const Object& lhs, const Object& rhs)	{return !operator<(lhs, rhs);}
+			StringView()								: mData(""), mLength(0) {}
+			StringView(const char* data, size_t length)	: mData(data), mLength(length) {}
+			StringView(const char* str)					: mData(str), mLength(strlen(str)) {}
+			StringView(const std::string& str)			: mData(str.c_str()), mLength(str.length()) {}
+
+			const char* data() const		{return mData;}
+			const char* c_str() const		{return mData;}
+			size_t size() const				{return mLength;}
+			size_t length() const			{return mLength;}
+			bool empty() const				{return mLength == 0;}
+			const char* begin() const		{return mData;}
+			const char* end() const			{return mData + mLength;}
+			char operator [](size_t i) const	{return mData[i];}
+
+			std::string str() const			{return std::string(mData, mLength);}
+			operator std::string() const	{return str();}
+
+			friend bool operator ==(const StringView& lhs, const StringView& rhs)
+			{
+				return (lhs.mLength == rhs.mLength) && ((lhs.mData == rhs.mData) || (memcmp(lhs.mData, rhs.mData, lhs.mLength) == 0));
+			}
+			inline friend bool operator !=(const StringView& lhs, const StringView& rhs) {return !(lhs == rhs);}
+	};
 
-			Value& operator [](const std::string& key);
-			const Value& operator [](const std::string& key) const;
-			Value& operator [](const char* key);
-			const Value& operator [](const char* key) const;
-		
-			ValueMap::const_iterator begin() const;
-			ValueMap::const_iterator end() const;
-			ValueMap::iterator begin();
-			ValueMap::iterator end();
+	class Value;
+	class Member;
 
-			// Find will return end() if the key can't be found, just like std::map does.
-			ValueMap::iterator find(const std::string& key);
-			ValueMap::const_iterator find(const std::string& key) const;
+	class ArrayView
+	{
+		protected:
 
-			// Convenience wrapper to find to search for a key
-			bool HasKey(const std::string& key) const;
+			const Value*	mValues;
+			size_t			mSize;
 
-			// Checks if the object contains all the keys in the array. If it does, returns -1.
-			// If it doesn't, returns the index of the first key it couldn't find.
-			int HasKeys(const std::vector<std::string>& keys) const;
-			int HasKeys(const char* keys[], int key_count) const;
+		public:
 
-			// Removes all values and resets the state back to default
-			void Clear();
+			typedef const Value* const_iterator;
 
-			size_t size() const {return mValues.size();}
+			ArrayView()										: mValues(0), mSize(0) {}
+			ArrayView(const Value* values, size_t size)		: mValues(values), mSize(size) {}
 
+			const Value& operator [](size_t i) const;
+			const_iterator begin() const	{return mValues;}
+			const_iterator end() const;
+			size_t size() const				{return mSize;}
+			bool empty() const				{return mSize == 0;}
 	};
 
-	class Array
+	class ObjectView
 	{
-		public:
-
-			typedef std::vector<Value> ValueVector;
-
 		protected:
 
-			ValueVector				mValues;
+			const Member*	mMembers;
+			size_t			mSize;
 
 		public:
 
-			Array();
-			Array(const Array& a);
-
-			Array& operator =(const Array& a);
-
-			friend bool operator ==(const Array& lhs, const Array& rhs);
-			inline friend bool operator !=(const Array& lhs, const Array& rhs) {return !(lhs == rhs);}
-			friend bool operator <(const Array& lhs, const Array& rhs);
-			inline friend bool operator >(const Array& lhs, const Array& rhs) 	{return operator<(rhs, lhs);}
-			inline friend bool operator <=(const Array& lhs, const Array& rhs)	{return !operator>(lhs, rhs);}
-			inline friend bool operator >=(const Array& lhs, const Array& rhs)	{return !operator<(lhs, rhs);}
+			typedef const Member* const_iterator;
 
-			Value& operator[] (size_t i);
-			const Value& operator[] (size_t i) const;
+			ObjectView()										: mMembers(0), mSize(0) {}
+			ObjectView(const Member* members, size_t size)		: mMembers(members), mSize(size) {}
 
-			ValueVector::const_iterator begin() const;
-			ValueVector::const_iterator end() const;
-			ValueVector::iterator begin();
-			ValueVector::iterator end();
+			// A NULLVal Value if the key can't be found
+			const Value& operator [](const StringView& key) const;
+			const Value& operator [](const char* key) const		{return (*this)[StringView(key)];}
+			const Value& operator [](const std::string& key) const	{return (*this)[StringView(key)];}
 
-			// Just a convenience wrapper for doing a std::find(Array::begin(), Array::end(), Value)
-			ValueVector::iterator find(const Value& v);
-			ValueVector::const_iterator find(const Value& v) const;
-
-			// Convenience wrapper to check if a value is in the array
-			bool HasValue(const Value& v) const;
+			// Find will return end() if the key can't be found, just like std::map does.
+			// Objects are searched linearly, from the end so the last of repeated keys wins.
+			const_iterator find(const StringView& key) const;
+			bool HasKey(const StringView& key) const		{return find(key) != end();}
 
-			// Removes all values and resets the state back to default
-			void Clear();
+			// Checks if the object contains all the keys in the array. If it does, returns -1.
+			// If it doesn't, returns the index of the first key it couldn't find.
+			int HasKeys(const std::vector<std::string>& keys) const;
+			int HasKeys(const char* keys[], int key_count) const;
 
-			void push_back(const Value& v);
-			void insert(size_t index, const Value& v);
-			size_t size() const;
+			const_iterator begin() const	{return mMembers;}
+			const_iterator end() const;
+			size_t size() const				{return mSize;}
+			bool empty() const				{return mSize == 0;}
 	};
 
 	class Value
 	{
+		friend class Document;
+
 		protected:
 
-			ValueType						mValueType;
-			int								mIntVal;
-			float							mFloatVal;
-			double 							mDoubleVal;
-			std::string						mStringVal;
-			Object							mObjectVal;
-			Array							mArrayVal;
-			bool 							mBoolVal;
+			unsigned char					mValueType;
+			// Characters of a string, elements of an array or members of an object
+			unsigned int					mSize;
+			union
+			{
+				int							mIntVal;
+				double						mDoubleVal;
+				bool						mBoolVal;
+				const char*					mStringVal;
+				const Value*				mArrayVal;
+				const Member*				mObjectVal;
+			};
 
 		public:
 
-			Value() 					: mValueType(NULLVal), mIntVal(0), mFloatVal(0), mDoubleVal(0), mBoolVal(false) {}
-			Value(int v)				: mValueType(IntVal), mIntVal(v), mFloatVal((float)v), mDoubleVal((double)v) {}
-			Value(float v)				: mValueType(FloatVal), mFloatVal(v), mIntVal((int)v), mDoubleVal((double)v) {}
-			Value(double v)				: mValueType(DoubleVal), mDoubleVal(v), mIntVal((int)v), mFloatVal((float)v) {}
-			Value(const std::string& v)	: mValueType(StringVal), mStringVal(v) {}
-			Value(const char* v)		: mValueType(StringVal), mStringVal(v) {}
-			Value(const Object& v)		: mValueType(ObjectVal), mObjectVal(v) {}
-			Value(const Array& v)		: mValueType(ArrayVal), mArrayVal(v) {}
-			Value(const bool v)			: mValueType(BoolVal), mBoolVal(v) {}
-			Value(const Value& v);
-
-			ValueType GetType() const {return mValueType;}
+			Value()						: mValueType(NULLVal), mSize(0), mDoubleVal(0) {}
+			explicit Value(int v)		: mValueType(IntVal), mSize(0) {mIntVal = v;}
+			explicit Value(double v)	: mValueType(DoubleVal), mSize(0) {mDoubleVal = v;}
+			explicit Value(bool v)		: mValueType(BoolVal), mSize(0) {mBoolVal = v;}
 
-			Value& operator =(const Value& v);
-
-			friend bool operator ==(const Value& lhs, const Value& rhs);
-			inline friend bool operator !=(const Value& lhs, const Value& rhs) 	{return !(lhs == rhs);}
-			friend bool operator <(const Value& lhs, const Value& rhs);
-			inline friend bool operator >(const Value& lhs, const Value& rhs) 	{return operator<(rhs, lhs);}
-			inline friend bool operator <=(const Value& lhs, const Value& rhs)	{return !operator>(lhs, rhs);}
-			inline friend bool operator >=(const Value& lhs, const Value& rhs)	{return !operator<(lhs, rhs);}
+			ValueType GetType() const {return (ValueType)mValueType;}
 
+			bool IsNull() const				{return mValueType == NULLVal;}
+			bool IsNumeric() const 			{return (mValueType == IntVal) || (mValueType == DoubleVal) || (mValueType == FloatVal);}
 
-			// For use with Array/ObjectVal types, respectively
-			Value& operator [](size_t idx);
+			// For use with Array/ObjectVal types, respectively.
+			// Missing keys give a NULLVal Value.
 			const Value& operator [](size_t idx) const;
-			Value& operator [](const std::string& key);
-			const Value& operator [](const std::string& key) const;
-			Value& operator [](const char* key);
-			const Value& operator [](const char* key) const;
-		
-			bool 		HasKey(const std::string& key) const;
+			const Value& operator [](int idx) const				{return (*this)[(size_t)idx];}
+			const Value& operator [](const StringView& key) const;
+			const Value& operator [](const char* key) const		{return (*this)[StringView(key)];}
+			const Value& operator [](const std::string& key) const	{return (*this)[StringView(key)];}
+
+			bool 		HasKey(const StringView& key) const;
 			int 		HasKeys(const std::vector<std::string>& keys) const;
 			int 		HasKeys(const char* keys[], int key_count) const;
 
-		
-			// non-operator versions
-			int 		ToInt() const		{assert(IsNumeric()); return mIntVal;}
-			float 		ToFloat() const		{assert(IsNumeric()); return mFloatVal;}
-			double 		ToDouble() const	{assert(IsNumeric()); return mDoubleVal;}
+			int 		ToInt() const		{assert(IsNumeric()); return mValueType == IntVal ? mIntVal : (int)mDoubleVal;}
+			float 		ToFloat() const		{assert(IsNumeric()); return mValueType == IntVal ? (float)mIntVal : (float)mDoubleVal;}
+			double 		ToDouble() const	{assert(IsNumeric()); return mValueType == IntVal ? (double)mIntVal : mDoubleVal;}
 			bool 		ToBool() const		{assert(mValueType == BoolVal); return mBoolVal;}
-			std::string	ToString() const	{assert(mValueType == StringVal); return mStringVal;}
-			Object 		ToObject() const	{assert(mValueType == ObjectVal); return mObjectVal;}
-			Array 		ToArray() const		{assert(mValueType == ArrayVal); return mArrayVal;}
-			
-			// Please note that as per C++ rules, implicitly casting a Value to a std::string won't work.
-			// This is because it could use the int/float/double/bool operators as well. So to assign a
-			// Value to a std::string you can either do:
-			// 		my_string = (std::string)my_value
-			// Or you can now do:
-			// 		my_string = my_value.ToString();
-			//
-			operator int() const 			{assert(IsNumeric()); return mIntVal;}
-			operator float() const 			{assert(IsNumeric()); return mFloatVal;}
-			operator double() const 		{assert(IsNumeric()); return mDoubleVal;}
-			operator bool() const 			{assert(mValueType == BoolVal); return mBoolVal;}
-			operator std::string() const 	{assert(mValueType == StringVal); return mStringVal;}
-			operator Object() const 		{assert(mValueType == ObjectVal); return mObjectVal;}
-			operator Array() const 			{assert(mValueType == ArrayVal); return mArrayVal;}
-
-			bool IsNumeric() const 			{return (mValueType == IntVal) || (mValueType == DoubleVal) || (mValueType == FloatVal);}
+			StringView	ToString() const	{assert(mValueType == StringVal); return StringView(mStringVal, mSize);}
+			ObjectView	ToObject() const	{assert(mValueType == ObjectVal); return ObjectView(mObjectVal, mSize);}
+			ArrayView	ToArray() const		{assert(mValueType == ArrayVal); return ArrayView(mArrayVal, mSize);}
+
+			operator int() const 			{return ToInt();}
+			operator float() const 			{return ToFloat();}
+			operator double() const 		{return ToDouble();}
+			operator bool() const 			{return ToBool();}
+			operator StringView() const 	{return ToString();}
+			operator ObjectView() const 	{return ToObject();}
+			operator ArrayView() const 		{return ToArray();}
 
 			// Returns 1 for anything not an Array/ObjectVal
 			size_t size() const;
 
 			// Resets the state back to default, aka NULLVal
-			void Clear();
+			void Clear()					{*this = Value();}
 
+			// The NULLVal Value returned for missing keys
+			static const Value& Null();
 	};
 
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	// Converts a JSON Object or Array instance into a JSON string representing it.
-	std::string Serialize(const Value& obj);
+	class Member
+	{
+		public:
 
-	// If there is an error, Value will be NULLType
-	Value 		Deserialize(const std::string& str);
+			// Interned by the Document
+			StringView		key;
+			Value			value;
+	};
 
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	inline bool operator ==(const Object& lhs, const Object& rhs)
+	inline const Value& ArrayView::operator [](size_t i) const
 	{
-		return lhs.mValues == rhs.mValues;
+		assert(i < mSize);
+		return mValues[i];
 	}
 
-	inline bool operator <(const Object& lhs, const Object& rhs)
+	inline ArrayView::const_iterator ArrayView::end() const
 	{
-		return lhs.mValues < rhs.mValues;
+		return mValues + mSize;
 	}
 
-	inline bool operator ==(const Array& lhs, const Array& rhs)
+	inline ObjectView::const_iterator ObjectView::end() const
 	{
-		return lhs.mValues == rhs.mValues;
+		return mMembers + mSize;
 	}
 
-	inline bool operator <(const Array& lhs, const Array& rhs)
+	// Bump allocator, everything is released at once
+	class Arena
 	{
-		return lhs.mValues < rhs.mValues;
-	}
+		protected:
 
-	/* When comparing different numeric types, this method works the same as if you compared different numeric types
-	 on your own. Thus it performs the same as if you, for example, did this:
+			std::vector<char*>	mBlocks;
+			char*				mCurrent;
+			size_t				mRemaining;
+			size_t				mUsed;
 
-	 	int a = 1;
-	 	float b = 1.1f;
-	 	bool equivalent = a == b;
+			Arena(const Arena&);
+			Arena& operator =(const Arena&);
 
-		The same logic applies to the other comparison operators.
-	 */
-	inline bool operator ==(const Value& lhs, const Value& rhs)
-	{
-		if ((lhs.mValueType != rhs.mValueType) && !lhs.IsNumeric() && !rhs.IsNumeric())
-			return false;
-
-		switch (lhs.mValueType)
-		{
-			case StringVal		: 	return lhs.mStringVal == rhs.mStringVal;
-
-			case IntVal			: 	if (rhs.GetType() == FloatVal)
-										return lhs.mIntVal == rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mIntVal == rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mIntVal == rhs.mIntVal;
-									else
-										return false;
-
-			case FloatVal		: 	if (rhs.GetType() == FloatVal)
-										return lhs.mFloatVal == rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mFloatVal == rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mFloatVal == rhs.mIntVal;
-									else
-										return false;
-
-
-			case DoubleVal		: 	if (rhs.GetType() == FloatVal)
-										return lhs.mDoubleVal == rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mDoubleVal == rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mDoubleVal == rhs.mIntVal;
-									else
-										return false;
-
-			case BoolVal		: 	return lhs.mBoolVal == rhs.mBoolVal;
-
-			case ObjectVal		: 	return lhs.mObjectVal == rhs.mObjectVal;
-
-			case ArrayVal		: 	return lhs.mArrayVal == rhs.mArrayVal;
-
-			default:
-				return true;
-		}
-	}
+		public:
+
+			static const size_t BLOCK_SIZE = 64 * 1024;
+
+			Arena();
+			~Arena();
 
-	inline bool operator <(const Value& lhs, const Value& rhs)
+			// Aligned for any Value
+			void* Allocate(size_t size);
+			void Clear();
+
+			// Bytes handed out since the last Clear
+			size_t GetMemoryUsage() const {return mUsed;}
+	};
+
+	// Owns a parsed document : its text, strings, arrays, objects and keys
+	class Document
 	{
-		if ((lhs.mValueType != rhs.mValueType) && !lhs.IsNumeric() && !rhs.IsNumeric())
-			return false;
-
-		switch (lhs.mValueType)
-		{
-			case StringVal		: 	return lhs.mStringVal < rhs.mStringVal;
-
-			case IntVal			: 	if (rhs.GetType() == FloatVal)
-										return lhs.mIntVal < rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mIntVal < rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mIntVal < rhs.mIntVal;
-									else
-										return false;
-
-			case FloatVal		: 	if (rhs.GetType() == FloatVal)
-										return lhs.mFloatVal < rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mFloatVal < rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mFloatVal < rhs.mIntVal;
-									else
-										return false;
-
-			case DoubleVal		: 	if (rhs.GetType() == FloatVal)
-										return lhs.mDoubleVal < rhs.mFloatVal;
-									else if (rhs.GetType() == DoubleVal)
-										return lhs.mDoubleVal < rhs.mDoubleVal;
-									else if (rhs.GetType() == IntVal)
-										return lhs.mDoubleVal < rhs.mIntVal;
-									else
-										return false;
-
-			case BoolVal		: 	return lhs.mBoolVal < rhs.mBoolVal;
-
-			case ObjectVal		: 	return lhs.mObjectVal < rhs.mObjectVal;
-
-			case ArrayVal		: 	return lhs.mArrayVal < rhs.mArrayVal;
-
-			default:
-				return true;
-		}
-	}
+		protected:
+
+			Arena						mArena;
+			Value						mRoot;
+			// Open addressing table of the interned keys, empty slots have no data
+			std::vector<StringView>		mKeys;
+			size_t						mKeyCount;
+			// Elements and members of the arrays and objects being parsed
+			std::vector<Value>			mValueStack;
+			std::vector<Member>			mMemberStack;
+
+			char*						mCursor;
+			const char*					mText;
+			std::string					mError;
+			size_t						mErrorOffset;
+
+			Document(const Document&);
+			Document& operator =(const Document&);
+
+			bool Fail(const char* error);
+			void SkipWhitespace();
+			bool ParseValue(Value& v, int depth);
+			bool ParseString(StringView& str);
+			bool ParseNumber(Value& v);
+			bool ParseArray(Value& v, int depth);
+			bool ParseObject(Value& v, int depth);
+			StringView InternKey(const StringView& key);
+
+		public:
+
+			// Deeper documents are rejected instead of overflowing the stack
+			static const int MAX_DEPTH = 512;
+
+			Document();
+
+			// Replaces the previous content. On error, Root() is NULLVal.
+			bool Parse(const char* text, size_t length);
+			bool Parse(const std::string& text)	{return Parse(text.data(), text.length());}
+
+			const Value& Root() const		{return mRoot;}
+
+			// Interned view of a key of the document, or the key itself if no object has it
+			StringView Key(const StringView& key) const;
+
+			const std::string& GetError() const	{return mError;}
+			size_t GetErrorOffset() const		{return mErrorOffset;}
+			size_t GetMemoryUsage() const		{return mArena.GetMemoryUsage() + mKeys.capacity() * sizeof(StringView);}
+
+			// Releases everything, every Value of the document becomes invalid
+			void Clear();
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Converts a JSON Value into a JSON string representing it.
+	std::string Serialize(const Value& v);
+
+	// If there is an error, the Value will be NULLType
+	const Value& Deserialize(const std::string& str, Document& document);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Deep comparison. Numeric types compare by value, whatever their type.
+	bool operator ==(const Value& lhs, const Value& rhs);
+	inline bool operator !=(const Value& lhs, const Value& rhs) {return !(lhs == rhs);}
 }
 
-#endif //__SUPER_EASY_JSON_H__
\ No newline at end of file
+#endif //__SUPER_EASY_JSON_H__
@@ -130,7 +130,9 @@ int main(int argc, char* argv[])
 
     std::vector<SoftEngine::Mesh> meshes;
     SoftEngine::Device device(WIDTH, HEIGHT);
-    device.loadJSONFile("../monkey.babylon", meshes);
+    // The binary scene made by sceneconverter is only mapped and copied, the JSON one is the fallback
+    if(!device.loadSceneFile("../monkey.scene", meshes))
+        device.loadJSONFile("../monkey.babylon", meshes);
 
     SoftEngine::Camera camera;
     camera.setPosition(glm::vec3(0.0f, 0.0f, -10.0f));
@@ -163,8 +165,18 @@ int main(int argc, char* argv[])
             mesh.setRotation(glm::vec3(mesh.rotation().x/* + 0.01f*/, mesh.rotation().y + 0.01f, mesh.rotation().z));
 
         device.render(camera, meshes);
+        device.resolve();
         render(device);
 
+#ifdef LOGGER
+        const SoftEngine::FrameStatistics& statistics = device.statistics();
+        std::cout << "Meshes " << statistics.meshes << " culled " << statistics.culledMeshes
+                  << " triangles " << statistics.triangles << " off screen " << statistics.offScreen
+                  << " back facing " << statistics.backFacing << " degenerate " << statistics.degenerate
+                  << " sub pixel " << statistics.subPixel << " clipped " << statistics.clipped
+                  << " rasterized " << statistics.rasterized << " occluded " << statistics.occluded << std::endl;
+#endif
+
         ++countedFrames;
         int frameTicks = capTimer.getTicks();
         if(frameTicks < SECONDS_PER_FRAME)
@@ -0,0 +1,104 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SoftEngine
+{
+MappedFile::~MappedFile()
+{
+    this->close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& filename)
+{
+    this->close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const Uint8 *>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file)
+        CloseHandle(m_file);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+    m_file = nullptr;
+}
+#else
+bool MappedFile::open(const std::string& filename)
+{
+    this->close();
+
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if(file < 0)
+        return false;
+
+    struct stat status;
+    if(fstat(file, &status) != 0 || status.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+
+    void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file alive
+    ::close(file);
+    if(data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const Uint8 *>(data);
+    m_size = status.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        munmap(const_cast<Uint8 *>(m_data), m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
+#endif
+
+}//end of namespace
@@ -0,0 +1,35 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include "SDL2/SDL_stdinc.h"
+
+namespace SoftEngine
+{
+// Read only view of a whole file, mapped in memory by the system
+class MappedFile
+{
+private:
+    const Uint8 *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+public:
+    MappedFile() {}
+    ~MappedFile();
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const Uint8* data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
+}// end of namespace
+
+#endif // MAPPEDFILE_H
@@ -2,6 +2,7 @@
 #define MESH_H
 
 #include "glm/glm.hpp"
+#include <memory>
 #include <string>
 #include <vector>
 #include "texture.h"
@@ -22,7 +23,6 @@ struct Vertex
 {
     glm::vec3 normal;
     glm::vec3 coordinates;
-    glm::vec3 worldCoordinates;
     glm::vec2 textureCoordinates;
 };
 
@@ -34,29 +34,41 @@ private:
     std::vector<Face> m_faces;
     glm::vec3 m_position = glm::vec3(0.0f);
     glm::vec3 m_rotation = glm::vec3(0.0f);
-    Texture *m_texture = nullptr;
+    // Shared with the other meshes using the same image, see TextureCache
+    std::shared_ptr<Texture> m_texture;
+    // Image the texture was loaded from, relative to the scene
+    std::string m_textureName;
+    glm::vec3 m_boundsMin = glm::vec3(0.0f);
+    glm::vec3 m_boundsMax = glm::vec3(0.0f);
+    glm::vec3 m_boundingCenter = glm::vec3(0.0f);
+    float m_boundingRadius = 0.0f;
 
 public:
     Mesh(std::string name, int verticesCount, int facesCount)
     : m_name(name), m_vertices(verticesCount), m_faces(facesCount)
     {}
 
-    ~Mesh()
-    {
-        delete m_texture;
-    }
-
     const std::string& name() const { return m_name; }
     std::vector<Vertex>& vertices() { return m_vertices; }
+    const std::vector<Vertex>& vertices() const { return m_vertices; }
     std::vector<Face>& faces() { return m_faces; }
+    const std::vector<Face>& faces() const { return m_faces; }
     glm::vec3 position() const { return m_position; }
     glm::vec3 rotation() const { return m_rotation; }
+    // Shared with the other meshes using the same image and sampler, so it is read only.
+    // Different sampler settings are loaded through TextureCache::load instead.
     const Texture& texture() const { return *m_texture; }
+    const std::string& textureName() const { return m_textureName; }
+    glm::vec3 boundsMin() const { return m_boundsMin; }
+    glm::vec3 boundsMax() const { return m_boundsMax; }
+    glm::vec3 boundingCenter() const { return m_boundingCenter; }
+    float boundingRadius() const { return m_boundingRadius; }
 
     void setName(const std::string& name) { m_name = name; }
     void setPosition(const glm::vec3& position ) { m_position = position; }
     void setRotation(const glm::vec3& rotation) { m_rotation = rotation; }
-    void setTexture(Texture* texture) { delete m_texture; m_texture = texture; }
+    void setTexture(std::shared_ptr<Texture> texture) { m_texture = texture; }
+    void setTextureName(const std::string& name) { m_textureName = name; }
 
     void computeFaceNormal() {
         for(Face& face : m_faces) {
@@ -70,6 +82,24 @@ public:
         }
     }
 
+    // Axis aligned box and sphere around the vertices, both in model space
+    void computeBounds() {
+        if(m_vertices.empty())
+            return;
+
+        m_boundsMin = m_vertices[0].coordinates;
+        m_boundsMax = m_vertices[0].coordinates;
+        for(const Vertex& vertex : m_vertices) {
+            m_boundsMin = glm::min(m_boundsMin, vertex.coordinates);
+            m_boundsMax = glm::max(m_boundsMax, vertex.coordinates);
+        }
+
+        m_boundingCenter = (m_boundsMin + m_boundsMax) * 0.5f;
+        m_boundingRadius = 0.0f;
+        for(const Vertex& vertex : m_vertices)
+            m_boundingRadius = glm::max(m_boundingRadius, glm::length(vertex.coordinates - m_boundingCenter));
+    }
+
 };
 
 } // end of namespace
@@ -0,0 +1,241 @@
+#include "meshoptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace SoftEngine
+{
+float averageCacheMissRatio(const std::vector<Face>& faces, int verticesCount, int cacheSize)
+{
+    if(faces.empty())
+        return 0.0f;
+
+    // Time each vertex entered the cache, it is still in while less than cacheSize vertices entered after it
+    std::vector<int> entered(verticesCount, -cacheSize - 1);
+    int misses = 0;
+    for(const Face& face : faces) {
+        for(int index : {face.A, face.B, face.C}) {
+            if(misses - entered[index] > cacheSize) {
+                entered[index] = misses;
+                ++misses;
+            }
+        }
+    }
+    return static_cast<float>(misses) / faces.size();
+}
+
+// Identical vertices, compared bit by bit
+struct VertexBits
+{
+    Uint32 bits[sizeof(Vertex) / sizeof(Uint32)];
+
+    bool operator==(const VertexBits& other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct VertexBitsHash
+{
+    size_t operator()(const VertexBits& vertex) const
+    {
+        size_t hash = 2166136261u;
+        for(Uint32 bits : vertex.bits)
+            hash = (hash ^ bits) * 16777619u;
+        return hash;
+    }
+};
+
+// Index of the first identical vertex of every vertex, in the order of the unique ones
+static int deduplicateVertices(const std::vector<Vertex>& vertices, std::vector<int>& remap)
+{
+    std::unordered_map<VertexBits, int, VertexBitsHash> unique;
+    unique.reserve(vertices.size());
+    remap.resize(vertices.size());
+    for(size_t i = 0; i < vertices.size(); ++i) {
+        VertexBits bits;
+        std::memcpy(bits.bits, &vertices[i], sizeof(Vertex));
+        remap[i] = unique.insert(std::make_pair(bits, static_cast<int>(unique.size()))).first->second;
+    }
+    return unique.size();
+}
+
+// Parameters of the reference implementation, tuned for a LRU cache of 32 vertices
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+static const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+static const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+// Vertices in the cache score by their position, the ones of the last triangle
+// a bit less so the next triangle does not just reuse them. Vertices with few
+// triangles left score higher, so they are finished instead of left behind.
+static float vertexScore(int cachePosition, int remainingTriangles)
+{
+    if(remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if(cachePosition >= 0) {
+        if(cachePosition < 3) {
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+    return score + FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+}
+
+static void orderTriangles(std::vector<Face>& faces, int verticesCount)
+{
+    int trianglesCount = faces.size();
+    if(trianglesCount == 0)
+        return;
+
+    // Triangles of every vertex, the first remaining[v] of them not emitted yet
+    std::vector<int> remaining(verticesCount, 0);
+    for(const Face& face : faces) {
+        ++remaining[face.A];
+        ++remaining[face.B];
+        ++remaining[face.C];
+    }
+    std::vector<int> offsets(verticesCount + 1, 0);
+    for(int v = 0; v < verticesCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<int> adjacency(offsets[verticesCount]);
+    std::vector<int> filled(offsets.begin(), offsets.end() - 1);
+    for(int t = 0; t < trianglesCount; ++t) {
+        adjacency[filled[faces[t].A]++] = t;
+        adjacency[filled[faces[t].B]++] = t;
+        adjacency[filled[faces[t].C]++] = t;
+    }
+
+    std::vector<int> cachePosition(verticesCount, -1);
+    std::vector<float> scores(verticesCount);
+    for(int v = 0; v < verticesCount; ++v)
+        scores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(trianglesCount);
+    std::vector<Uint8> emitted(trianglesCount, 0);
+    int best = 0;
+    for(int t = 0; t < trianglesCount; ++t) {
+        triangleScores[t] = scores[faces[t].A] + scores[faces[t].B] + scores[faces[t].C];
+        if(triangleScores[t] > triangleScores[best])
+            best = t;
+    }
+
+    // Room for the three vertices of the new triangle before the cache is trimmed
+    int cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    int nextUnemitted = 0;
+    std::vector<Face> ordered;
+    ordered.reserve(trianglesCount);
+
+    while(best >= 0) {
+        const Face& face = faces[best];
+        emitted[best] = 1;
+        ordered.push_back(face);
+
+        int triangle[3] = {face.A, face.B, face.C};
+        int newCache[FORSYTH_CACHE_SIZE + 3];
+        int newCount = 0;
+        for(int v : triangle) {
+            int *first = adjacency.data() + offsets[v];
+            int *last = first + remaining[v];
+            std::iter_swap(std::find(first, last, best), last - 1);
+            --remaining[v];
+
+            if(std::find(newCache, newCache + newCount, v) == newCache + newCount)
+                newCache[newCount++] = v;
+        }
+        for(int i = 0; i < cacheCount; ++i) {
+            if(cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                newCache[newCount++] = cache[i];
+        }
+
+        // The vertices pushed out of the cache are updated too
+        for(int i = 0; i < newCount; ++i) {
+            int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            scores[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        for(int i = 0; i < newCount; ++i) {
+            int v = newCache[i];
+            for(int j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+                const Face& adjacent = faces[adjacency[j]];
+                triangleScores[adjacency[j]] = scores[adjacent.A] + scores[adjacent.B] + scores[adjacent.C];
+            }
+        }
+
+        cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+        for(int i = 0; i < cacheCount; ++i)
+            cache[i] = newCache[i];
+
+        // Only the triangles of the cached vertices changed, the best one is among them
+        best = -1;
+        float bestScore = -1.0f;
+        for(int i = 0; i < cacheCount; ++i) {
+            int v = cache[i];
+            for(int j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+                if(triangleScores[adjacency[j]] > bestScore) {
+                    best = adjacency[j];
+                    bestScore = triangleScores[best];
+                }
+            }
+        }
+        // Nothing left around the cache, start again from the next triangle in the input
+        if(best < 0) {
+            while(nextUnemitted < trianglesCount && emitted[nextUnemitted])
+                ++nextUnemitted;
+            if(nextUnemitted < trianglesCount)
+                best = nextUnemitted;
+        }
+    }
+    faces.swap(ordered);
+}
+
+MeshOptimization optimizeMesh(Mesh& mesh)
+{
+    std::vector<Vertex>& vertices = mesh.vertices();
+    std::vector<Face>& faces = mesh.faces();
+
+    MeshOptimization result;
+    result.verticesBefore = vertices.size();
+    result.triangles = faces.size();
+    result.acmrBefore = averageCacheMissRatio(faces, vertices.size());
+
+    std::vector<int> remap;
+    int uniqueCount = deduplicateVertices(vertices, remap);
+    for(Face& face : faces) {
+        face.A = remap[face.A];
+        face.B = remap[face.B];
+        face.C = remap[face.C];
+    }
+
+    orderTriangles(faces, uniqueCount);
+
+    // Unique vertex of every vertex, then position of the unique vertices in first use order
+    std::vector<int> order(uniqueCount, -1);
+    int usedCount = 0;
+    for(Face& face : faces) {
+        for(int *index : {&face.A, &face.B, &face.C}) {
+            if(order[*index] < 0)
+                order[*index] = usedCount++;
+            *index = order[*index];
+        }
+    }
+
+    std::vector<Vertex> reordered(usedCount);
+    for(size_t i = 0; i < vertices.size(); ++i) {
+        int position = order[remap[i]];
+        if(position >= 0)
+            reordered[position] = vertices[i];
+    }
+    vertices.swap(reordered);
+    mesh.computeBounds();
+
+    result.verticesAfter = vertices.size();
+    result.acmrAfter = averageCacheMissRatio(faces, vertices.size());
+    return result;
+}
+
+}//end of namespace
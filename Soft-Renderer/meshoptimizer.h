@@ -0,0 +1,30 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <vector>
+#include "mesh.h"
+
+namespace SoftEngine
+{
+// Cache simulated to measure the average cache miss ratio, the number of
+// vertices transformed per triangle by a FIFO post-transform cache
+static const int ACMR_CACHE_SIZE = 16;
+
+struct MeshOptimization
+{
+    int verticesBefore = 0;
+    int verticesAfter = 0;
+    int triangles = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+float averageCacheMissRatio(const std::vector<Face>& faces, int verticesCount, int cacheSize = ACMR_CACHE_SIZE);
+
+// Merges the identical vertices, orders the triangles for vertex cache reuse
+// with Tom Forsyth's linear-speed vertex cache optimisation, then stores the
+// vertices in the order the triangles first use them. Unused vertices are dropped.
+MeshOptimization optimizeMesh(Mesh& mesh);
+}// end of namespace
+
+#endif // MESHOPTIMIZER_H
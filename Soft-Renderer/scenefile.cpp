@@ -0,0 +1,170 @@
+#include "scenefile.h"
+#include <fstream>
+#include <map>
+
+namespace SoftEngine
+{
+// The blobs are the in memory arrays, so their layout is part of the format
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex is stored as is in scene files");
+static_assert(sizeof(Face) == 3 * sizeof(int) + 3 * sizeof(float), "Face is stored as is in scene files");
+
+static Uint64 align(Uint64 offset)
+{
+    return (offset + SCENE_FILE_ALIGNMENT - 1) & ~static_cast<Uint64>(SCENE_FILE_ALIGNMENT - 1);
+}
+
+bool SceneFile::open(const std::string& filename)
+{
+    m_header = nullptr;
+    if(!m_file.open(filename))
+        return false;
+
+    if(m_file.size() < sizeof(SceneFileHeader)) {
+        m_file.close();
+        return false;
+    }
+    m_header = reinterpret_cast<const SceneFileHeader *>(m_file.data());
+
+    if(!this->validate()) {
+        m_header = nullptr;
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+static bool isAligned(Uint64 offset, Uint64 alignment)
+{
+    return offset % alignment == 0;
+}
+
+// Every table, string and blob has to be inside the file and aligned for its type
+bool SceneFile::validate() const
+{
+    Uint64 size = m_file.size();
+    if(m_header->magic != SCENE_FILE_MAGIC || m_header->version != SCENE_FILE_VERSION)
+        return false;
+
+    if(!isAligned(m_header->meshesOffset, alignof(SceneFileMesh)) ||
+       !isAligned(m_header->materialsOffset, alignof(SceneFileMaterial)))
+        return false;
+    if(m_header->meshesOffset > size || (size - m_header->meshesOffset) / sizeof(SceneFileMesh) < m_header->meshesCount)
+        return false;
+    if(m_header->materialsOffset > size || (size - m_header->materialsOffset) / sizeof(SceneFileMaterial) < m_header->materialsCount)
+        return false;
+    if(m_header->stringsOffset > size || size - m_header->stringsOffset < m_header->stringsSize)
+        return false;
+    // The last string is terminated, so every offset in the table gives a terminated string
+    if(m_header->stringsSize == 0 || this->string(m_header->stringsSize - 1)[0] != '\0')
+        return false;
+
+    for(int i = 0; i < this->materialsCount(); ++i) {
+        if(this->material(i).diffuseTextureName >= m_header->stringsSize)
+            return false;
+    }
+
+    for(int i = 0; i < this->meshesCount(); ++i) {
+        const SceneFileMesh& mesh = this->mesh(i);
+        if(mesh.name >= m_header->stringsSize)
+            return false;
+        if(mesh.material >= static_cast<Sint32>(m_header->materialsCount) || mesh.material < -1)
+            return false;
+        if(!isAligned(mesh.verticesOffset, SCENE_FILE_ALIGNMENT) || !isAligned(mesh.facesOffset, SCENE_FILE_ALIGNMENT))
+            return false;
+        if(mesh.verticesOffset > size || (size - mesh.verticesOffset) / sizeof(Vertex) < mesh.verticesCount)
+            return false;
+        if(mesh.facesOffset > size || (size - mesh.facesOffset) / sizeof(Face) < mesh.facesCount)
+            return false;
+
+        const Face *faces = this->faces(mesh);
+        for(Uint32 j = 0; j < mesh.facesCount; ++j) {
+            if(static_cast<Uint32>(faces[j].A) >= mesh.verticesCount ||
+               static_cast<Uint32>(faces[j].B) >= mesh.verticesCount ||
+               static_cast<Uint32>(faces[j].C) >= mesh.verticesCount)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void writePadding(std::ofstream& file, Uint64 offset)
+{
+    static const char zeros[SCENE_FILE_ALIGNMENT] = {};
+    Uint64 position = file.tellp();
+    file.write(zeros, offset - position);
+}
+
+bool saveSceneFile(const std::string& filename, const std::vector<Mesh>& meshes)
+{
+    std::string strings;
+    auto addString = [&strings](const std::string& string) {
+        Uint32 offset = strings.size();
+        strings.append(string.c_str(), string.size() + 1);
+        return offset;
+    };
+    // Offset 0 is the empty string, so the table is never empty
+    addString("");
+
+    std::vector<SceneFileMaterial> materials;
+    std::map<std::string, int> materialIndices;
+    std::vector<SceneFileMesh> records(meshes.size());
+
+    SceneFileHeader header = {};
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    header.meshesCount = meshes.size();
+    header.meshesOffset = sizeof(SceneFileHeader);
+
+    for(size_t i = 0; i < meshes.size(); ++i) {
+        const Mesh& mesh = meshes[i];
+        SceneFileMesh& record = records[i];
+        record = SceneFileMesh();
+        record.verticesCount = mesh.vertices().size();
+        record.facesCount = mesh.faces().size();
+        record.name = addString(mesh.name());
+        record.position[0] = mesh.position().x;
+        record.position[1] = mesh.position().y;
+        record.position[2] = mesh.position().z;
+
+        record.material = -1;
+        if(!mesh.textureName().empty()) {
+            auto material = materialIndices.find(mesh.textureName());
+            if(material == materialIndices.end()) {
+                material = materialIndices.insert(std::make_pair(mesh.textureName(), materials.size())).first;
+                materials.push_back(SceneFileMaterial{addString(mesh.textureName())});
+            }
+            record.material = material->second;
+        }
+    }
+
+    header.materialsCount = materials.size();
+    header.materialsOffset = header.meshesOffset + records.size() * sizeof(SceneFileMesh);
+    header.stringsOffset = header.materialsOffset + materials.size() * sizeof(SceneFileMaterial);
+    header.stringsSize = strings.size();
+
+    Uint64 offset = header.stringsOffset + header.stringsSize;
+    for(size_t i = 0; i < meshes.size(); ++i) {
+        records[i].verticesOffset = offset = align(offset);
+        offset += meshes[i].vertices().size() * sizeof(Vertex);
+        records[i].facesOffset = offset = align(offset);
+        offset += meshes[i].faces().size() * sizeof(Face);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if(!file)
+        return false;
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(SceneFileMesh));
+    file.write(reinterpret_cast<const char *>(materials.data()), materials.size() * sizeof(SceneFileMaterial));
+    file.write(strings.data(), strings.size());
+    for(size_t i = 0; i < meshes.size(); ++i) {
+        writePadding(file, records[i].verticesOffset);
+        file.write(reinterpret_cast<const char *>(meshes[i].vertices().data()), meshes[i].vertices().size() * sizeof(Vertex));
+        writePadding(file, records[i].facesOffset);
+        file.write(reinterpret_cast<const char *>(meshes[i].faces().data()), meshes[i].faces().size() * sizeof(Face));
+    }
+    return static_cast<bool>(file);
+}
+
+}//end of namespace
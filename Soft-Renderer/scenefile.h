@@ -0,0 +1,93 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <string>
+#include <vector>
+#include "SDL2/SDL_stdinc.h"
+#include "mappedfile.h"
+#include "mesh.h"
+
+namespace SoftEngine
+{
+// Binary scene : a header, the mesh and material tables, a table of zero
+// terminated strings, then the vertices and faces of every mesh stored exactly
+// like Mesh holds them, each blob aligned to a cache line. Offsets are from the
+// start of the file and everything is little endian, so a mapped file is used as is.
+static const Uint32 SCENE_FILE_MAGIC = 0x4e435353; // "SSCN"
+static const Uint32 SCENE_FILE_VERSION = 1;
+static const int SCENE_FILE_ALIGNMENT = 64;
+
+struct SceneFileHeader
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 meshesCount;
+    Uint32 materialsCount;
+    Uint64 meshesOffset;
+    Uint64 materialsOffset;
+    Uint64 stringsOffset;
+    Uint64 stringsSize;
+};
+
+struct SceneFileMesh
+{
+    Uint64 verticesOffset;
+    Uint64 facesOffset;
+    Uint32 verticesCount;
+    Uint32 facesCount;
+    // In the string table
+    Uint32 name;
+    // In the material table, -1 for untextured meshes
+    Sint32 material;
+    float position[3];
+    Uint32 padding;
+};
+
+struct SceneFileMaterial
+{
+    // In the string table
+    Uint32 diffuseTextureName;
+};
+
+// Mapped binary scene, checked once when opened
+class SceneFile
+{
+private:
+    MappedFile m_file;
+    const SceneFileHeader *m_header = nullptr;
+
+    bool validate() const;
+public:
+    bool open(const std::string& filename);
+
+    int meshesCount() const { return m_header->meshesCount; }
+    const SceneFileMesh& mesh(int index) const
+    {
+        return reinterpret_cast<const SceneFileMesh *>(m_file.data() + m_header->meshesOffset)[index];
+    }
+    const Vertex* vertices(const SceneFileMesh& mesh) const
+    {
+        return reinterpret_cast<const Vertex *>(m_file.data() + mesh.verticesOffset);
+    }
+    const Face* faces(const SceneFileMesh& mesh) const
+    {
+        return reinterpret_cast<const Face *>(m_file.data() + mesh.facesOffset);
+    }
+
+    int materialsCount() const { return m_header->materialsCount; }
+    const SceneFileMaterial& material(int index) const
+    {
+        return reinterpret_cast<const SceneFileMaterial *>(m_file.data() + m_header->materialsOffset)[index];
+    }
+
+    const char* string(Uint32 offset) const
+    {
+        return reinterpret_cast<const char *>(m_file.data() + m_header->stringsOffset + offset);
+    }
+};
+
+// Meshes sharing a texture name share a material
+bool saveSceneFile(const std::string& filename, const std::vector<Mesh>& meshes);
+}// end of namespace
+
+#endif // SCENEFILE_H
@@ -0,0 +1,146 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <cmath>
+#endif
+
+namespace SoftEngine
+{
+
+// Eight packed floats. Maps to one AVX register, two SSE registers or a
+// plain array depending on what the compiler was told it can use.
+// Comparisons return lane masks which can be combined with & and read
+// back with movemask().
+struct Float8
+{
+#if defined(__AVX__)
+    __m256 v;
+
+    Float8() {}
+    Float8(__m256 value) : v(value) {}
+    explicit Float8(float scalar) : v(_mm256_set1_ps(scalar)) {}
+    Float8(float f0, float f1, float f2, float f3, float f4, float f5, float f6, float f7)
+        : v(_mm256_setr_ps(f0, f1, f2, f3, f4, f5, f6, f7)) {}
+
+    static Float8 load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+#elif defined(__SSE2__)
+    __m128 lo;
+    __m128 hi;
+
+    Float8() {}
+    Float8(__m128 low, __m128 high) : lo(low), hi(high) {}
+    explicit Float8(float scalar) : lo(_mm_set1_ps(scalar)), hi(lo) {}
+    Float8(float f0, float f1, float f2, float f3, float f4, float f5, float f6, float f7)
+        : lo(_mm_setr_ps(f0, f1, f2, f3)), hi(_mm_setr_ps(f4, f5, f6, f7)) {}
+
+    static Float8 load(const float* p) { return Float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+    void store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+#else
+    float v[8];
+
+    Float8() {}
+    explicit Float8(float scalar) { for(int i = 0; i < 8; ++i) v[i] = scalar; }
+    Float8(float f0, float f1, float f2, float f3, float f4, float f5, float f6, float f7)
+    {
+        v[0] = f0; v[1] = f1; v[2] = f2; v[3] = f3;
+        v[4] = f4; v[5] = f5; v[6] = f6; v[7] = f7;
+    }
+
+    static Float8 load(const float* p) { Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for(int i = 0; i < 8; ++i) p[i] = v[i]; }
+#endif
+
+    // 0, 1, 2 ... 7
+    static Float8 ramp() { return Float8(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+};
+
+#if defined(__AVX__)
+inline Float8 operator+(const Float8& a, const Float8& b) { return _mm256_add_ps(a.v, b.v); }
+inline Float8 operator-(const Float8& a, const Float8& b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float8 operator*(const Float8& a, const Float8& b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float8 operator/(const Float8& a, const Float8& b) { return _mm256_div_ps(a.v, b.v); }
+inline Float8 operator&(const Float8& a, const Float8& b) { return _mm256_and_ps(a.v, b.v); }
+inline Float8 operator|(const Float8& a, const Float8& b) { return _mm256_or_ps(a.v, b.v); }
+inline Float8 operator==(const Float8& a, const Float8& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline Float8 operator<(const Float8& a, const Float8& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline Float8 operator<=(const Float8& a, const Float8& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline Float8 operator>(const Float8& a, const Float8& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Float8 operator>=(const Float8& a, const Float8& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline Float8 min(const Float8& a, const Float8& b) { return _mm256_min_ps(a.v, b.v); }
+inline Float8 max(const Float8& a, const Float8& b) { return _mm256_max_ps(a.v, b.v); }
+inline Float8 sqrt(const Float8& a) { return _mm256_sqrt_ps(a.v); }
+inline Float8 floor(const Float8& a) { return _mm256_floor_ps(a.v); }
+inline int movemask(const Float8& mask) { return _mm256_movemask_ps(mask.v); }
+#elif defined(__SSE2__)
+inline Float8 operator+(const Float8& a, const Float8& b) { return Float8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+inline Float8 operator-(const Float8& a, const Float8& b) { return Float8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+inline Float8 operator*(const Float8& a, const Float8& b) { return Float8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+inline Float8 operator/(const Float8& a, const Float8& b) { return Float8(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+inline Float8 operator&(const Float8& a, const Float8& b) { return Float8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+inline Float8 operator|(const Float8& a, const Float8& b) { return Float8(_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)); }
+inline Float8 operator==(const Float8& a, const Float8& b) { return Float8(_mm_cmpeq_ps(a.lo, b.lo), _mm_cmpeq_ps(a.hi, b.hi)); }
+inline Float8 operator<(const Float8& a, const Float8& b) { return Float8(_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)); }
+inline Float8 operator<=(const Float8& a, const Float8& b) { return Float8(_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)); }
+inline Float8 operator>(const Float8& a, const Float8& b) { return Float8(_mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi)); }
+inline Float8 operator>=(const Float8& a, const Float8& b) { return Float8(_mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi)); }
+inline Float8 min(const Float8& a, const Float8& b) { return Float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+inline Float8 max(const Float8& a, const Float8& b) { return Float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+inline Float8 sqrt(const Float8& a) { return Float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+// SSE2 has no rounding instruction : truncate and step down the negative values.
+// Only valid for values which fit in an int.
+inline __m128 floor4(__m128 a)
+{
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmplt_ps(a, truncated), _mm_set1_ps(1.0f)));
+}
+inline Float8 floor(const Float8& a) { return Float8(floor4(a.lo), floor4(a.hi)); }
+inline int movemask(const Float8& mask) { return _mm_movemask_ps(mask.lo) | (_mm_movemask_ps(mask.hi) << 4); }
+#else
+#define SOFTENGINE_FLOAT8_OP(op) \
+    inline Float8 operator op(const Float8& a, const Float8& b) \
+    { Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = a.v[i] op b.v[i]; return r; }
+#define SOFTENGINE_FLOAT8_CMP(op) \
+    inline Float8 operator op(const Float8& a, const Float8& b) \
+    { Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = (a.v[i] op b.v[i]) ? -1.0f : 0.0f; return r; }
+SOFTENGINE_FLOAT8_OP(+)
+SOFTENGINE_FLOAT8_OP(-)
+SOFTENGINE_FLOAT8_OP(*)
+SOFTENGINE_FLOAT8_OP(/)
+SOFTENGINE_FLOAT8_CMP(<)
+SOFTENGINE_FLOAT8_CMP(<=)
+SOFTENGINE_FLOAT8_CMP(>)
+SOFTENGINE_FLOAT8_CMP(>=)
+SOFTENGINE_FLOAT8_CMP(==)
+#undef SOFTENGINE_FLOAT8_OP
+#undef SOFTENGINE_FLOAT8_CMP
+// Masks are stored as -1.0f / 0.0f, so the sign bit carries the lane state.
+inline Float8 operator&(const Float8& a, const Float8& b)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = (a.v[i] < 0.0f && b.v[i] < 0.0f) ? -1.0f : 0.0f; return r; }
+inline Float8 operator|(const Float8& a, const Float8& b)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = (a.v[i] < 0.0f || b.v[i] < 0.0f) ? -1.0f : 0.0f; return r; }
+// Like the SSE instructions, min and max return the second operand when a lane is NaN
+inline Float8 min(const Float8& a, const Float8& b)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline Float8 max(const Float8& a, const Float8& b)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline Float8 sqrt(const Float8& a)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline Float8 floor(const Float8& a)
+{ Float8 r; for(int i = 0; i < 8; ++i) r.v[i] = std::floor(a.v[i]); return r; }
+inline int movemask(const Float8& mask)
+{ int r = 0; for(int i = 0; i < 8; ++i) r |= (mask.v[i] < 0.0f ? 1 : 0) << i; return r; }
+#endif
+
+inline Float8 operator+(const Float8& a, float b) { return a + Float8(b); }
+inline Float8 operator-(const Float8& a, float b) { return a - Float8(b); }
+inline Float8 operator*(const Float8& a, float b) { return a * Float8(b); }
+
+}// end of namespace
+
+#endif // SIMD_H
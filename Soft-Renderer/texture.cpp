@@ -1,30 +1,451 @@
 #include "texture.h"
+#include "blockcompression.h"
+#include "simd.h"
+#include <atomic>
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <utility>
+#include <algorithm>
 #include <cmath>
 
 namespace SoftEngine
 {
-Texture::Texture(std::string filename, int width, int height)
-    : m_width(width), m_height(height)
+static const size_t TEXEL_ALIGNMENT = 64;
+
+static bool isPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+Texture::Texture()
+{
+    this->allocate(1, 1);
+    m_levels[0].texels[0] = Color::White;
+}
+
+Texture::Texture(std::string filename)
 {
-    this->load(filename);
+    if(filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".dds") == 0)
+        this->loadDDS(filename);
+    else
+        this->load(filename);
+    if(m_levels.empty()) {
+        this->allocate(1, 1);
+        m_levels[0].texels[0] = Color::White;
+    }
+}
+
+Texture::Texture(int width, int height, const Color *texels)
+{
+    this->allocate(width, height);
+    this->copyTexels(texels, width * sizeof(Color));
 }
 
 Texture::~Texture()
 {
-    if(m_surface)
-        SDL_FreeSurface(m_surface);
+    delete [] m_storage;
 }
 
 Texture& Texture::operator=(Texture&& other)
 {
-    m_width = other.m_width;
-    m_height = other.m_height;
-    std::swap(m_surface, other.m_surface);
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    std::swap(m_powerOfTwo, other.m_powerOfTwo);
+    std::swap(m_filter, other.m_filter);
+    std::swap(m_layout, other.m_layout);
+    std::swap(m_format, other.m_format);
+    std::swap(m_blockBytes, other.m_blockBytes);
+    std::swap(m_serial, other.m_serial);
+    std::swap(m_levels, other.m_levels);
+    std::swap(m_storage, other.m_storage);
 
     return *this;
 }
 
+static int blockBytes(TextureFormat format)
+{
+    switch(format) {
+    case TextureFormat::BC1: return BC1_BLOCK_BYTES;
+    case TextureFormat::BC3: return BC3_BLOCK_BYTES;
+    default: return Texture::TEXEL_BLOCK_SIZE * Texture::TEXEL_BLOCK_SIZE * sizeof(Color);
+    }
+}
+
+// Lays out the mip chain, halving each size down to 1x1 unless a number of levels is given
+void Texture::allocate(int width, int height, TextureFormat format, int levels)
+{
+    static std::atomic<Uint32> serials(0);
+    delete [] m_storage;
+
+    m_width = width;
+    m_height = height;
+    m_powerOfTwo = isPowerOfTwo(width) && isPowerOfTwo(height);
+    m_format = format;
+    m_blockBytes = blockBytes(format);
+    m_serial = ++serials;
+
+    m_levels.clear();
+    size_t size = 0;
+    std::vector<size_t> offsets;
+    for(int levelWidth = width, levelHeight = height; ; levelWidth = std::max(levelWidth / 2, 1), levelHeight = std::max(levelHeight / 2, 1)) {
+        int blocksPerRow = (levelWidth + TEXEL_BLOCK_SIZE - 1) / TEXEL_BLOCK_SIZE;
+        int blocksPerColumn = (levelHeight + TEXEL_BLOCK_SIZE - 1) / TEXEL_BLOCK_SIZE;
+        MipLevel level = {levelWidth, levelHeight, levelWidth - 1, levelHeight - 1, blocksPerRow, nullptr, nullptr};
+        m_levels.push_back(level);
+        offsets.push_back(size);
+        size += (static_cast<size_t>(blocksPerRow) * blocksPerColumn * m_blockBytes + TEXEL_ALIGNMENT - 1) & ~(TEXEL_ALIGNMENT - 1);
+        if((levelWidth == 1 && levelHeight == 1) || static_cast<int>(m_levels.size()) == levels)
+            break;
+    }
+
+    m_storage = new Uint8[size + TEXEL_ALIGNMENT];
+    size_t address = (reinterpret_cast<size_t>(m_storage) + TEXEL_ALIGNMENT - 1) & ~(TEXEL_ALIGNMENT - 1);
+    for(size_t i = 0; i < m_levels.size(); ++i) {
+        if(format == TextureFormat::Uncompressed)
+            m_levels[i].texels = reinterpret_cast<Color*>(address + offsets[i]);
+        else
+            m_levels[i].blocks = reinterpret_cast<Uint8*>(address + offsets[i]);
+    }
+}
+
+// Fills level 0 from rows of pitch bytes, in the current layout, and builds the mip chain
+void Texture::copyTexels(const Color *texels, int pitch)
+{
+    const Uint8 *rows = reinterpret_cast<const Uint8 *>(texels);
+    const MipLevel& level = m_levels[0];
+    TextureLayout layout = m_layout;
+    m_layout = TextureLayout::Linear;
+    for(int y = 0; y < m_height; ++y)
+        std::memcpy(level.texels + y * m_width, rows + y * pitch, m_width * sizeof(Color));
+    this->generateMipmaps();
+    this->setLayout(layout);
+}
+
+void Texture::setLayout(TextureLayout layout)
+{
+    if(layout == m_layout || m_format != TextureFormat::Uncompressed)
+        return;
+
+    std::vector<Color> texels;
+    for(const MipLevel& level : m_levels) {
+        int blocksPerColumn = (level.height + TEXEL_BLOCK_SIZE - 1) / TEXEL_BLOCK_SIZE;
+        texels.assign(level.texels, level.texels + level.blocksPerRow * blocksPerColumn * TEXEL_BLOCK_SIZE * TEXEL_BLOCK_SIZE);
+        for(int y = 0; y < level.height; ++y)
+            for(int x = 0; x < level.width; ++x)
+                level.texels[texelIndex(layout, level, x, y)] = texels[texelIndex(m_layout, level, x, y)];
+    }
+    m_layout = layout;
+}
+
+// Every texel of a level is the average of the 2x2 texels above it. Odd sizes
+// repeat their last row or column. Works on the linear layout.
+void Texture::generateMipmaps()
+{
+    for(size_t i = 1; i < m_levels.size(); ++i) {
+        const MipLevel& source = m_levels[i - 1];
+        MipLevel& level = m_levels[i];
+        for(int y = 0; y < level.height; ++y) {
+            const Color *row0 = source.texels + std::min(2 * y, source.height - 1) * source.width;
+            const Color *row1 = source.texels + std::min(2 * y + 1, source.height - 1) * source.width;
+            for(int x = 0; x < level.width; ++x) {
+                int x0 = std::min(2 * x, source.width - 1);
+                int x1 = std::min(2 * x + 1, source.width - 1);
+                Uint32 c00 = row0[x0].color(), c10 = row0[x1].color();
+                Uint32 c01 = row1[x0].color(), c11 = row1[x1].color();
+                Uint32 result = 0;
+                for(int shift = 0; shift < 32; shift += 8) {
+                    Uint32 sum = ((c00 >> shift) & 0xff) + ((c10 >> shift) & 0xff)
+                            + ((c01 >> shift) & 0xff) + ((c11 >> shift) & 0xff);
+                    result |= ((sum + 2) / 4) << shift;
+                }
+                level.texels[x + y * level.width] = Color::fromPacked(result);
+            }
+        }
+    }
+}
+
+void Texture::compress(TextureFormat format)
+{
+    if(m_format != TextureFormat::Uncompressed || format == TextureFormat::Uncompressed)
+        return;
+
+    Texture compressed;
+    compressed.allocate(m_width, m_height, format);
+    for(size_t i = 0; i < m_levels.size(); ++i) {
+        const MipLevel& level = m_levels[i];
+        const MipLevel& target = compressed.m_levels[i];
+        Uint8 *block = target.blocks;
+        for(int blockY = 0; blockY < level.height; blockY += COMPRESSED_BLOCK_SIZE) {
+            for(int blockX = 0; blockX < level.width; blockX += COMPRESSED_BLOCK_SIZE, block += compressed.m_blockBytes) {
+                // Blocks hanging over the edges repeat the last row and column
+                Color texels[COMPRESSED_BLOCK_TEXELS];
+                for(int y = 0; y < COMPRESSED_BLOCK_SIZE; ++y) {
+                    for(int x = 0; x < COMPRESSED_BLOCK_SIZE; ++x) {
+                        int u = std::min(blockX + x, level.width - 1);
+                        int v = std::min(blockY + y, level.height - 1);
+                        texels[x + y * COMPRESSED_BLOCK_SIZE] = level.texels[texelIndex(m_layout, level, u, v)];
+                    }
+                }
+                if(format == TextureFormat::BC1)
+                    encodeBC1(texels, block);
+                else
+                    encodeBC3(texels, block);
+            }
+        }
+    }
+
+    compressed.m_filter = m_filter;
+    *this = std::move(compressed);
+}
+
+// Recently decoded blocks of the calling thread, so neighbouring samples decode a block once
+struct DecodedBlock
+{
+    Uint32 serial;
+    const Uint8 *block;
+    Color texels[COMPRESSED_BLOCK_TEXELS];
+};
+// Slots are picked from the block position, so an 8x8 area of blocks of two
+// consecutive mip levels, what trilinear filtering reads, fits without conflicts
+static const int DECODED_BLOCKS_COUNT = 128;
+static thread_local DecodedBlock decodedBlocks[DECODED_BLOCKS_COUNT];
+
+Color Texture::compressedTexel(const MipLevel& level, int u, int v) const
+{
+    int blockX = u >> TEXEL_BLOCK_SHIFT;
+    int blockY = v >> TEXEL_BLOCK_SHIFT;
+    const Uint8 *block = level.blocks + (blockY * level.blocksPerRow + blockX) * m_blockBytes;
+
+    int levelIndex = &level - m_levels.data();
+    DecodedBlock& decoded = decodedBlocks[(blockX & 7) | ((blockY & 7) << 3) | ((levelIndex & 1) << 6)];
+    if(decoded.block != block || decoded.serial != m_serial) {
+        if(m_format == TextureFormat::BC1)
+            decodeBC1(block, decoded.texels);
+        else
+            decodeBC3(block, decoded.texels);
+        decoded.block = block;
+        decoded.serial = m_serial;
+    }
+    return decoded.texels[(u & (TEXEL_BLOCK_SIZE - 1)) + (v & (TEXEL_BLOCK_SIZE - 1)) * TEXEL_BLOCK_SIZE];
+}
+
+// Minimal DDS layout : the magic number followed by the 124 byte header, as 32 bit words
+static const int DDS_HEADER_WORDS = 32;
+static const Uint32 DDS_MAGIC = 0x20534444;
+static const Uint32 DDS_FLAGS = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+static const Uint32 DDS_PIXEL_FORMAT_FOURCC = 0x4;
+static const Uint32 DDS_CAPS = 0x1000 | 0x8 | 0x400000;
+static const Uint32 FOURCC_DXT1 = 0x31545844;
+static const Uint32 FOURCC_DXT5 = 0x35545844;
+static const Uint32 DDSD_MIPMAPCOUNT = 0x20000;
+// Larger sizes are not produced by any of our tools and would only come from a damaged file
+static const Uint32 DDS_MAX_SIZE = 16384;
+
+static size_t levelBytes(const MipLevel& level, int bytes)
+{
+    return static_cast<size_t>(level.blocksPerRow) * ((level.height + COMPRESSED_BLOCK_SIZE - 1) / COMPRESSED_BLOCK_SIZE) * bytes;
+}
+
+// Levels of the full mip chain, down to 1x1
+static Uint32 mipChainLength(Uint32 width, Uint32 height)
+{
+    Uint32 levels = 1;
+    for(Uint32 size = std::max(width, height); size > 1; size /= 2)
+        ++levels;
+    return levels;
+}
+
+bool Texture::saveDDS(const std::string& path) const
+{
+    if(m_format == TextureFormat::Uncompressed)
+        return false;
+
+    Uint32 header[DDS_HEADER_WORDS] = {};
+    header[0] = DDS_MAGIC;
+    header[1] = 124;
+    header[2] = DDS_FLAGS;
+    header[3] = m_height;
+    header[4] = m_width;
+    header[5] = static_cast<Uint32>(levelBytes(m_levels[0], m_blockBytes));
+    header[7] = m_levels.size();
+    header[19] = 32;
+    header[20] = DDS_PIXEL_FORMAT_FOURCC;
+    header[21] = m_format == TextureFormat::BC1 ? FOURCC_DXT1 : FOURCC_DXT5;
+    header[27] = DDS_CAPS;
+
+    // DDS files are little endian, like the platforms we run on
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for(const MipLevel& level : m_levels)
+        file.write(reinterpret_cast<const char*>(level.blocks), levelBytes(level, m_blockBytes));
+    return file.good();
+}
+
+bool Texture::loadDDS(std::string filename)
+{
+    std::ifstream file("../" + filename, std::ios::binary);
+    Uint32 header[DDS_HEADER_WORDS];
+    if(!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != DDS_MAGIC) {
+        std::cerr << "Cannot load compressed texture named " << filename << std::endl;
+        return false;
+    }
+
+    TextureFormat format;
+    if(header[21] == FOURCC_DXT1) {
+        format = TextureFormat::BC1;
+    } else if(header[21] == FOURCC_DXT5) {
+        format = TextureFormat::BC3;
+    } else {
+        std::cerr << "Unsupported format in compressed texture named " << filename << std::endl;
+        return false;
+    }
+
+    Uint32 width = header[4];
+    Uint32 height = header[3];
+    if(width < 1 || width > DDS_MAX_SIZE || height < 1 || height > DDS_MAX_SIZE) {
+        std::cerr << "Invalid size " << width << "x" << height << " in compressed texture named " << filename << std::endl;
+        return false;
+    }
+    // The mip count is only meaningful with its flag set
+    Uint32 levels = (header[2] & DDSD_MIPMAPCOUNT) ? std::max<Uint32>(header[7], 1) : 1;
+    levels = std::min(levels, mipChainLength(width, height));
+
+    this->allocate(width, height, format, levels);
+    for(const MipLevel& level : m_levels)
+        file.read(reinterpret_cast<char*>(level.blocks), levelBytes(level, m_blockBytes));
+    if(!file) {
+        std::cerr << "Truncated compressed texture named " << filename << std::endl;
+        delete [] m_storage;
+        m_storage = nullptr;
+        m_levels.clear();
+        return false;
+    }
+    return true;
+}
+
+Color Texture::sampleBilinear(const MipLevel& level, float tu, float tv) const
+{
+    // Texel centers sit at half coordinates
+    float u = tu * level.width - 0.5f;
+    float v = tv * level.height - 0.5f;
+    float u0 = std::floor(u);
+    float v0 = std::floor(v);
+    Uint8 weightU = static_cast<Uint8>((u - u0) * 255.0f + 0.5f);
+    Uint8 weightV = static_cast<Uint8>((v - v0) * 255.0f + 0.5f);
+    int x = static_cast<int>(u0);
+    int y = static_cast<int>(v0);
+
+    Color top = lerp(this->texel(level, x, y), this->texel(level, x + 1, y), weightU);
+    Color bottom = lerp(this->texel(level, x, y + 1), this->texel(level, x + 1, y + 1), weightU);
+    return lerp(top, bottom, weightV);
+}
+
+// Vector version of sampleBilinear() : the coordinates and fixed point weights are
+// computed eight at a time, texels gathered one by one and blended four at a time
+void Texture::sampleBilinear(const int *levels, const float *tu, const float *tv, int mask, Color *texels) const
+{
+    alignas(32) float widths[BATCH_SIZE];
+    alignas(32) float heights[BATCH_SIZE];
+    for(int i = 0; i < BATCH_SIZE; ++i) {
+        widths[i] = m_levels[levels[i]].width;
+        heights[i] = m_levels[levels[i]].height;
+    }
+
+    Float8 u = Float8::load(tu) * Float8::load(widths) - 0.5f;
+    Float8 v = Float8::load(tv) * Float8::load(heights) - 0.5f;
+    Float8 u0 = floor(u);
+    Float8 v0 = floor(v);
+
+    alignas(32) float xs[BATCH_SIZE];
+    alignas(32) float ys[BATCH_SIZE];
+    alignas(32) float fractionsU[BATCH_SIZE];
+    alignas(32) float fractionsV[BATCH_SIZE];
+    u0.store(xs);
+    v0.store(ys);
+    ((u - u0) * 255.0f + 0.5f).store(fractionsU);
+    ((v - v0) * 255.0f + 0.5f).store(fractionsV);
+
+    Color topLeft[BATCH_SIZE], topRight[BATCH_SIZE], bottomLeft[BATCH_SIZE], bottomRight[BATCH_SIZE];
+    Uint8 weightsU[BATCH_SIZE], weightsV[BATCH_SIZE];
+    for(int i = 0; i < BATCH_SIZE; ++i) {
+        if(!((mask >> i) & 1)) {
+            topLeft[i] = topRight[i] = bottomLeft[i] = bottomRight[i] = Color();
+            weightsU[i] = weightsV[i] = 0;
+            continue;
+        }
+        const MipLevel& level = m_levels[levels[i]];
+        int x = static_cast<int>(xs[i]);
+        int y = static_cast<int>(ys[i]);
+        topLeft[i] = this->texel(level, x, y);
+        topRight[i] = this->texel(level, x + 1, y);
+        bottomLeft[i] = this->texel(level, x, y + 1);
+        bottomRight[i] = this->texel(level, x + 1, y + 1);
+        weightsU[i] = static_cast<Uint8>(fractionsU[i]);
+        weightsV[i] = static_cast<Uint8>(fractionsV[i]);
+    }
+
+    lerp(topLeft, topLeft, topRight, weightsU, BATCH_SIZE);
+    lerp(bottomLeft, bottomLeft, bottomRight, weightsU, BATCH_SIZE);
+    lerp(texels, topLeft, bottomLeft, weightsV, BATCH_SIZE);
+}
+
+void Texture::sample(const float *tu, const float *tv, const float *lods, int mask, Color *texels) const
+{
+    const int lastLevel = m_levels.size() - 1;
+    int levels[BATCH_SIZE];
+
+    if(m_filter == TextureFilter::Trilinear) {
+        Uint8 weights[BATCH_SIZE];
+        for(int i = 0; i < BATCH_SIZE; ++i) {
+            float lod = lods[i] > 0.0f ? std::min(lods[i], static_cast<float>(lastLevel)) : 0.0f;
+            levels[i] = static_cast<int>(lod);
+            weights[i] = static_cast<Uint8>((lod - levels[i]) * 255.0f + 0.5f);
+        }
+        Color coarse[BATCH_SIZE];
+        this->sampleBilinear(levels, tu, tv, mask, texels);
+        for(int i = 0; i < BATCH_SIZE; ++i)
+            levels[i] = std::min(levels[i] + 1, lastLevel);
+        this->sampleBilinear(levels, tu, tv, mask, coarse);
+        lerp(texels, texels, coarse, weights, BATCH_SIZE);
+        return;
+    }
+
+    for(int i = 0; i < BATCH_SIZE; ++i)
+        levels[i] = lods[i] > 0.5f ? std::min(static_cast<int>(lods[i] + 0.5f), lastLevel) : 0;
+
+    if(m_filter == TextureFilter::Bilinear) {
+        this->sampleBilinear(levels, tu, tv, mask, texels);
+        return;
+    }
+    for(int i = 0; i < BATCH_SIZE; ++i) {
+        if((mask >> i) & 1)
+            texels[i] = this->sampleNearest(m_levels[levels[i]], tu[i], tv[i]);
+    }
+}
+
+Color Texture::sample(float tu, float tv, float lod) const
+{
+    const int lastLevel = m_levels.size() - 1;
+
+    if(m_filter == TextureFilter::Trilinear) {
+        lod = lod > 0.0f ? std::min(lod, static_cast<float>(lastLevel)) : 0.0f;
+        int level = static_cast<int>(lod);
+        Color fine = this->sampleBilinear(m_levels[level], tu, tv);
+        if(level == lastLevel)
+            return fine;
+        Color coarse = this->sampleBilinear(m_levels[level + 1], tu, tv);
+        return lerp(fine, coarse, static_cast<Uint8>((lod - level) * 255.0f + 0.5f));
+    }
+
+    // Nearest level. NaN and negative (magnified) levels of detail map to level 0.
+    int level = lod > 0.5f ? std::min(static_cast<int>(lod + 0.5f), lastLevel) : 0;
+    if(m_filter == TextureFilter::Bilinear)
+        return this->sampleBilinear(m_levels[level], tu, tv);
+    return this->sampleNearest(m_levels[level], tu, tv);
+}
+
+// Decodes the whole image once, so sampling never has to go through SDL, and builds its mip chain
 void Texture::load(std::string filename)
 {
     SDL_Surface *image;
@@ -35,31 +456,20 @@ void Texture::load(std::string filename)
         return;
     }
 
-    m_surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
+    // RGBA8888 is the packed layout of Color
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(image);
 
-    if(!m_surface) {
+    if(!surface) {
         std::cerr << "Cannot convert image named " << filename << std::endl;
         std::cerr << "With error : " << SDL_GetError() << std::endl;
+        return;
     }
 
+    this->allocate(surface->w, surface->h);
+    this->copyTexels(static_cast<const Color *>(surface->pixels), surface->pitch);
 
-    SDL_FreeSurface(image);
-}
-
-Color Texture::map(float tu, float tv) const
-{
-    if(!m_surface)
-        return Color::White;
-
-    int u = std::abs(static_cast<int>(tu * m_width) % m_width);
-    int v = std::abs(static_cast<int>(tv * m_height) % m_height);
-    int pos = (u + v * m_width);
-
-    Uint32 *pixels = static_cast<Uint32 *>(m_surface->pixels);
-    Uint8 r, g, b, a;
-    SDL_GetRGBA(pixels[pos], m_surface->format, &r, &g, &b, &a);
-
-    return Color(r, g, b, a);
+    SDL_FreeSurface(surface);
 }
 
 }//end of namespace
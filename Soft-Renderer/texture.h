@@ -1,28 +1,165 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <cmath>
+#include <vector>
 #include "SDL2/SDL_image.h"
 #include "color.h"
 
 namespace SoftEngine
 {
+enum class TextureFilter
+{
+    // Nearest texel of the nearest mip level
+    Nearest,
+    // Four texels of the nearest mip level
+    Bilinear,
+    // Bilinear samples of the two closest mip levels, blended
+    Trilinear
+};
+
+enum class TextureLayout
+{
+    // Row after row
+    Linear,
+    // 4x4 blocks of texels, one cache line each, stored row after row
+    Tiled
+};
+
+enum class TextureFormat
+{
+    // Color per texel
+    Uncompressed,
+    // 8 bytes per 4x4 block, opaque
+    BC1,
+    // 16 bytes per 4x4 block, BC1 colors plus interpolated alpha
+    BC3
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    // Wrapping masks, only used when both sizes are powers of two
+    int widthMask;
+    int heightMask;
+    // Storage is padded to whole blocks, whatever the layout
+    int blocksPerRow;
+    // texels for uncompressed textures, blocks for compressed ones
+    Color *texels;
+    Uint8 *blocks;
+};
+
 class Texture
 {
 private:
     int m_width = 0;
     int m_height = 0;
-    SDL_Surface* m_surface = nullptr;
+    bool m_powerOfTwo = false;
+    TextureFilter m_filter = TextureFilter::Nearest;
+    TextureLayout m_layout = TextureLayout::Linear;
+    TextureFormat m_format = TextureFormat::Uncompressed;
+    int m_blockBytes = 0;
+    // Tells apart the storages of all textures ever allocated for the decoded block caches
+    Uint32 m_serial = 0;
+    // Every level of the mip chain, level 0 being the image itself.
+    // The texels of all levels live in m_storage, each level aligned to a cache line.
+    std::vector<MipLevel> m_levels;
+    Uint8 *m_storage = nullptr;
+
+    void allocate(int width, int height, TextureFormat format = TextureFormat::Uncompressed, int levels = 0);
+    void copyTexels(const Color *texels, int pitch);
     void load(std::string filename);
+    bool loadDDS(std::string filename);
+    void generateMipmaps();
+
+    static int wrap(int coordinate, int size)
+    {
+        coordinate %= size;
+        return coordinate < 0 ? coordinate + size : coordinate;
+    }
+
+    Color texel(const MipLevel& level, int u, int v) const
+    {
+        if(m_powerOfTwo) {
+            u &= level.widthMask;
+            v &= level.heightMask;
+        } else {
+            u = wrap(u, level.width);
+            v = wrap(v, level.height);
+        }
+        if(m_format != TextureFormat::Uncompressed)
+            return this->compressedTexel(level, u, v);
+        return level.texels[texelIndex(m_layout, level, u, v)];
+    }
+
+    Color compressedTexel(const MipLevel& level, int u, int v) const;
+
+    Color sampleNearest(const MipLevel& level, float tu, float tv) const
+    {
+        // Floor rather than truncate so negative coordinates wrap instead of mirroring around zero
+        return this->texel(level, static_cast<int>(std::floor(tu * level.width)),
+                           static_cast<int>(std::floor(tv * level.height)));
+    }
+
+    Color sampleBilinear(const MipLevel& level, float tu, float tv) const;
+    void sampleBilinear(const int *levels, const float *tu, const float *tv, int mask, Color *texels) const;
 public:
+    static const int TEXEL_BLOCK_SHIFT = 2;
+    static const int TEXEL_BLOCK_SIZE = 1 << TEXEL_BLOCK_SHIFT;
+
+    // Single white texel
     Texture();
-    Texture(std::string filename, int width, int height);
+    explicit Texture(std::string filename);
+    // Copy of width x height texels stored row after row
+    Texture(int width, int height, const Color *texels);
     Texture(const Texture& other) = delete;
     Texture& operator=(const Texture& other) = delete;
     ~Texture();
 
     Texture& operator=(Texture&& other);
 
-    Color map(float tu, float tv) const;
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int levels() const { return m_levels.size(); }
+    const MipLevel& level(int index) const { return m_levels[index]; }
+
+    TextureLayout layout() const { return m_layout; }
+    // Reorders the texels of every level. Compressed textures are always stored in blocks.
+    void setLayout(TextureLayout layout);
+
+    TextureFormat format() const { return m_format; }
+    // Encodes every level, the uncompressed texels are released
+    void compress(TextureFormat format);
+    // Writes a compressed texture with its mip chain as a DDS file, which the
+    // filename constructor loads back without decoding
+    bool saveDDS(const std::string& path) const;
+
+    // Position of the texel (u, v), inside the level, in its storage
+    static int texelIndex(TextureLayout layout, const MipLevel& level, int u, int v)
+    {
+        if(layout == TextureLayout::Linear)
+            return u + v * level.width;
+        // u and v are never negative, so the shifts and masks divide by the block size
+        return (((v >> TEXEL_BLOCK_SHIFT) * level.blocksPerRow + (u >> TEXEL_BLOCK_SHIFT)) << (2 * TEXEL_BLOCK_SHIFT))
+                | ((v & (TEXEL_BLOCK_SIZE - 1)) << TEXEL_BLOCK_SHIFT) | (u & (TEXEL_BLOCK_SIZE - 1));
+    }
+
+    TextureFilter filter() const { return m_filter; }
+    void setFilter(TextureFilter filter) { m_filter = filter; }
+
+    // Nearest texel of the full resolution image, repeating outside [0, 1]
+    Color map(float tu, float tv) const
+    {
+        return this->sampleNearest(m_levels[0], tu, tv);
+    }
+
+    // Filtered sample at the level of detail lod, the log2 of the texels covered by a pixel
+    Color sample(float tu, float tv, float lod) const;
+    // Same as sample() for eight pixels at once. Only the lanes set in mask are sampled,
+    // the other texels are left undefined.
+    static const int BATCH_SIZE = 8;
+    void sample(const float *tu, const float *tv, const float *lods, int mask, Color *texels) const;
 };
 }// end of namespace
 
@@ -0,0 +1,156 @@
+#include "texturecache.h"
+#include <iostream>
+
+namespace SoftEngine
+{
+std::shared_ptr<Texture> TextureCache::load(const std::string& filename, TextureFilter filter, TextureLayout layout)
+{
+    std::weak_ptr<Texture>& entry = m_textures[Key(filename, filter, layout)];
+    std::shared_ptr<Texture> texture = entry.lock();
+    if(texture)
+        return texture;
+
+    texture = std::make_shared<Texture>();
+    texture->setFilter(filter);
+    texture->setLayout(layout);
+    entry = texture;
+
+    std::weak_ptr<Texture> target = texture;
+    this->queue([this, filename, filter, layout, target] {
+        // Every queued job must publish a result, or wait() would never return
+        std::shared_ptr<Texture> decoded;
+        try {
+            decoded = std::make_shared<Texture>(filename);
+        } catch(const std::exception& error) {
+            std::cerr << "Cannot decode texture named " << filename << " : " << error.what() << std::endl;
+            decoded = std::make_shared<Texture>();
+        }
+        decoded->setFilter(filter);
+        decoded->setLayout(layout);
+        this->publish(target, decoded);
+    });
+    return texture;
+}
+
+void TextureCache::queue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_pending;
+    }
+    m_workers.run(std::move(job));
+}
+
+void TextureCache::publish(const std::weak_ptr<Texture>& target, std::shared_ptr<Texture> texture)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_decoded.push_back(DecodedTexture{target, std::move(texture)});
+    m_decodeFinished.notify_all();
+}
+
+// Whether the placeholder was given a layout or a compression after its job was
+// queued, which the decoded texture has to be converted to before it is published
+static bool needsConversion(const Texture& texture, const Texture& placeholder)
+{
+    if(texture.format() != TextureFormat::Uncompressed)
+        return false;
+    return placeholder.format() != TextureFormat::Uncompressed || placeholder.layout() != texture.layout();
+}
+
+void TextureCache::convert(const std::weak_ptr<Texture>& target, std::shared_ptr<Texture> texture,
+                           TextureLayout layout, TextureFormat format)
+{
+    this->queue([this, target, texture, layout, format] {
+        std::shared_ptr<Texture> converted = texture;
+        try {
+            converted->setLayout(layout);
+            converted->compress(format);
+        } catch(const std::exception& error) {
+            std::cerr << "Cannot convert texture : " << error.what() << std::endl;
+            converted = std::make_shared<Texture>();
+            converted->setFilter(texture->filter());
+            converted->setLayout(layout);
+            converted->compress(format);
+        }
+        this->publish(target, converted);
+    });
+}
+
+std::shared_ptr<Texture> TextureCache::white()
+{
+    if(!m_white)
+        m_white = std::make_shared<Texture>();
+    return m_white;
+}
+
+int TextureCache::update()
+{
+    std::vector<DecodedTexture> decoded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        decoded.swap(m_decoded);
+        m_pending -= decoded.size();
+    }
+
+    int updated = 0;
+    for(DecodedTexture& entry : decoded) {
+        std::shared_ptr<Texture> target = entry.target.lock();
+        if(!target)
+            continue;
+
+        // Keep what was changed on the placeholder meanwhile. Conversions are too
+        // slow for the frame, so they go back to the workers.
+        Texture& texture = *entry.texture;
+        texture.setFilter(target->filter());
+        if(needsConversion(texture, *target)) {
+            this->convert(entry.target, entry.texture, target->layout(), target->format());
+            continue;
+        }
+
+        *target = std::move(texture);
+        ++updated;
+    }
+    return updated;
+}
+
+int TextureCache::wait()
+{
+    // Updating can queue conversions, which are waited for as well
+    int updated = 0;
+    do {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_decodeFinished.wait(lock, [this] { return m_pending == static_cast<int>(m_decoded.size()); });
+        }
+        updated += this->update();
+    } while(this->pending() > 0);
+    return updated;
+}
+
+int TextureCache::pending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+void TextureCache::purge()
+{
+    for(auto it = m_textures.begin(); it != m_textures.end(); ) {
+        if(it->second.expired())
+            it = m_textures.erase(it);
+        else
+            ++it;
+    }
+}
+
+int TextureCache::size() const
+{
+    int count = 0;
+    for(const auto& entry : m_textures) {
+        if(!entry.second.expired())
+            ++count;
+    }
+    return count;
+}
+
+}//end of namespace
@@ -0,0 +1,77 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "texture.h"
+#include "threadpool.h"
+
+namespace SoftEngine
+{
+// Loads every image once per sampler settings and hands out shared handles to it.
+// The cache itself only keeps weak references, so a texture is freed with the
+// last mesh using it.
+//
+// Images are decoded on a thread pool. Until update() publishes the decoded
+// image, the handle holds a white placeholder. The cache is used by one thread
+// at a time, the workers never touch the handed out textures.
+class TextureCache
+{
+private:
+    typedef std::tuple<std::string, TextureFilter, TextureLayout> Key;
+    std::map<Key, std::weak_ptr<Texture>> m_textures;
+    // Shared by the meshes without a texture, kept for the lifetime of the cache
+    std::shared_ptr<Texture> m_white;
+
+    struct DecodedTexture
+    {
+        std::weak_ptr<Texture> target;
+        std::shared_ptr<Texture> texture;
+    };
+    // Filled by the workers, guarded by m_mutex
+    std::vector<DecodedTexture> m_decoded;
+    int m_pending = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_decodeFinished;
+
+    // Last member, so the workers are stopped before the rest is destroyed
+    ThreadPool m_workers;
+
+    // Counts the job as pending until its result is published
+    void queue(std::function<void()> job);
+    void publish(const std::weak_ptr<Texture>& target, std::shared_ptr<Texture> texture);
+    // Applies on a worker the layout and the compression set on a placeholder while its image was decoded
+    void convert(const std::weak_ptr<Texture>& target, std::shared_ptr<Texture> texture,
+                 TextureLayout layout, TextureFormat format);
+public:
+    std::shared_ptr<Texture> load(const std::string& filename,
+                                  TextureFilter filter = TextureFilter::Nearest,
+                                  TextureLayout layout = TextureLayout::Linear);
+    // 1x1 white texture for the meshes without one
+    std::shared_ptr<Texture> white();
+
+    // Replaces the placeholders of the images decoded since the last call.
+    // Only moves finished textures into place, a layout or compression set on a
+    // placeholder meanwhile is applied on the workers first and published by a later call.
+    // Must not run while a frame is drawn. Returns the number of textures replaced.
+    int update();
+    // Waits for every queued image, then updates
+    int wait();
+    // Images queued and not published yet
+    int pending();
+
+    // Drops the entries of the textures which are not used anymore
+    void purge();
+
+    // Textures currently alive
+    int size() const;
+};
+}// end of namespace
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,54 @@
+#include "threadpool.h"
+#include <algorithm>
+
+namespace SoftEngine
+{
+ThreadPool::ThreadPool(int threads)
+{
+    if(threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for(int i = 0; i < threads; ++i)
+        m_workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_jobs.clear();
+    }
+    m_jobQueued.notify_all();
+
+    for(std::thread& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::run(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobQueued.notify_one();
+}
+
+void ThreadPool::work()
+{
+    for(;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobQueued.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if(m_stopping)
+                return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
+
+}//end of namespace
@@ -0,0 +1,39 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SoftEngine
+{
+// Runs jobs on worker threads, in the order they were queued.
+// Meant for work done next to the frame, like loading, the frame
+// itself stays on OpenMP.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobQueued;
+    bool m_stopping = false;
+
+    void work();
+public:
+    // One worker per hardware thread when threads is 0
+    explicit ThreadPool(int threads = 0);
+    // Jobs which did not start yet are dropped
+    ~ThreadPool();
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    void run(std::function<void()> job);
+    int threads() const { return m_workers.size(); }
+};
+}// end of namespace
+
+#endif // THREADPOOL_H
@@ -0,0 +1,68 @@
+// Converts a Babylon JSON scene to the binary scene format of scenefile.h,
+// which Device::loadSceneFile() maps and copies without any parsing.
+//
+// usage : sceneconverter <input.babylon> <output.scene> [--optimize]
+//
+// --optimize reorders the meshes for vertex cache reuse once, instead of at every load
+
+#include "babylonloader.h"
+#include "meshoptimizer.h"
+#include "scenefile.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SoftEngine;
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3) {
+        std::cerr << "usage : " << argv[0] << " <input.babylon> <output.scene> [--optimize]" << std::endl;
+        return 1;
+    }
+
+    std::string option = argc > 3 ? argv[3] : "";
+    if(!option.empty() && option != "--optimize") {
+        std::cerr << "Unknown option " << option << std::endl;
+        return 1;
+    }
+
+    // Only the texture names are written, so the images are never loaded
+    std::vector<Mesh> meshes;
+    loadBabylonFile(argv[1], meshes);
+    if(meshes.empty()) {
+        std::cerr << "No meshes in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    if(option == "--optimize") {
+        int count = meshes.size();
+        int triangles = 0;
+        double missesBefore = 0.0;
+        double missesAfter = 0.0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:triangles, missesBefore, missesAfter)
+        for(int i = 0; i < count; ++i) {
+            MeshOptimization optimization = optimizeMesh(meshes[i]);
+            triangles += optimization.triangles;
+            missesBefore += static_cast<double>(optimization.acmrBefore) * optimization.triangles;
+            missesAfter += static_cast<double>(optimization.acmrAfter) * optimization.triangles;
+        }
+        if(triangles > 0)
+            std::cout << "ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles << std::endl;
+    }
+
+    if(!saveSceneFile(argv[2], meshes)) {
+        std::cerr << "Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    size_t vertices = 0;
+    size_t faces = 0;
+    for(const Mesh& mesh : meshes) {
+        vertices += mesh.vertices().size();
+        faces += mesh.faces().size();
+    }
+    std::cout << argv[1] << " : " << meshes.size() << " meshes, " << vertices << " vertices, "
+              << faces << " faces written to " << argv[2] << std::endl;
+    return 0;
+}
@@ -0,0 +1,47 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+CONFIG += c++11
+QMAKE_CXXFLAGS += -fopenmp
+QMAKE_LFLAGS *= -fopenmp
+
+TARGET = sceneconverter
+INCLUDEPATH += ..
+
+macx{
+LIBS += -L/usr/local/lib -lSDL2 -lSDL2_image
+INCLUDEPATH += /usr/local/include
+}
+
+win32{
+LIBS += C:\Libraries\SDL2_image-2.0.0\i686-w64-mingw32\lib\libSDL2_image.a \
+    C:\Libraries\SDL2-2.0.3\lib\x86\SDL2.lib
+INCLUDEPATH += C:\Libraries\SDL2-2.0.3\include \
+            C:\Libraries\glm
+}
+
+SOURCES += sceneconverter.cpp \
+    ../babylonloader.cpp \
+    ../blockcompression.cpp \
+    ../mesh.cpp \
+    ../meshoptimizer.cpp \
+    ../color.cpp \
+    ../mappedfile.cpp \
+    ../scenefile.cpp \
+    ../texture.cpp \
+    ../texturecache.cpp \
+    ../threadpool.cpp
+
+HEADERS += \
+    ../babylonloader.h \
+    ../blockcompression.h \
+    ../mesh.h \
+    ../meshoptimizer.h \
+    ../color.h \
+    ../mappedfile.h \
+    ../scenefile.h \
+    ../simd.h \
+    ../texture.h \
+    ../texturecache.h \
+    ../threadpool.h
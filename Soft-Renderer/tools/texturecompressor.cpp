@@ -0,0 +1,59 @@
+// Compresses an image to a BC1 or BC3 DDS file with its full mip chain,
+// ready to be referenced by a scene in place of the original image.
+//
+// usage : texturecompressor <input image> <output.dds> [bc1|bc3]
+
+#include "texture.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SoftEngine;
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3) {
+        std::cerr << "usage : " << argv[0] << " <input image> <output.dds> [bc1|bc3]" << std::endl;
+        return 1;
+    }
+
+    std::string mode = argc > 3 ? argv[3] : "bc1";
+    if(mode != "bc1" && mode != "bc3") {
+        std::cerr << "Unknown format " << mode << ", expected bc1 or bc3" << std::endl;
+        return 1;
+    }
+
+    SDL_Surface *image = IMG_Load(argv[1]);
+    if(!image) {
+        std::cerr << "Cannot load image named " << argv[1] << std::endl;
+        std::cerr << "With error : " << IMG_GetError() << std::endl;
+        return 1;
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(image);
+    if(!surface) {
+        std::cerr << "Cannot convert image named " << argv[1] << std::endl;
+        std::cerr << "With error : " << SDL_GetError() << std::endl;
+        return 1;
+    }
+
+    std::vector<Color> texels(surface->w * surface->h);
+    for(int y = 0; y < surface->h; ++y) {
+        const Uint32 *row = reinterpret_cast<const Uint32 *>(static_cast<const Uint8 *>(surface->pixels) + y * surface->pitch);
+        for(int x = 0; x < surface->w; ++x)
+            texels[x + y * surface->w] = Color::fromPacked(row[x]);
+    }
+
+    Texture texture(surface->w, surface->h, texels.data());
+    SDL_FreeSurface(surface);
+
+    texture.compress(mode == "bc1" ? TextureFormat::BC1 : TextureFormat::BC3);
+    if(!texture.saveDDS(argv[2])) {
+        std::cerr << "Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::cout << argv[1] << " : " << texture.width() << "x" << texture.height() << ", "
+              << texture.levels() << " levels written to " << argv[2] << std::endl;
+    return 0;
+}